@@ -0,0 +1,81 @@
+#include "gameArchive.h"
+
+#include <array>
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+
+// Prints the games of an archive, one per line, or only the totals of a scan:
+//   archivedump <archive> [stats]
+namespace {
+    constexpr std::array<const char *, 5> RESULTS{"first won", "second won", "draw", "first left", "second left"};
+
+    void printPlayer(std::ostream &out, std::string_view login) {
+        if (login.empty()) {
+            out << "bot";
+        } else {
+            out << login;
+        }
+    }
+
+    void print(std::ostream &out, const archive::game &record) {
+        const std::time_t second = static_cast<std::time_t>(record.startedAt / 1000);
+        std::tm local{};
+        localtime_r(&second, &local);
+        out << std::put_time(&local, "%Y-%m-%d %H:%M:%S") << ' ' << int{record.boardSize} << 'x'
+            << int{record.boardSize} << '/' << int{record.winLength} << ' ';
+        printPlayer(out, record.players[0]);
+        out << " - ";
+        printPlayer(out, record.players[1]);
+        out << ' ' << (record.result < RESULTS.size() ? RESULTS[record.result] : "?") << ' '
+            << record.duration << " ms:";
+        for (size_t i = 0; i < record.moveCount; ++i) {
+            out << ' ' << record.move(i);
+        }
+        out << '\n';
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argc > 3 || (argc == 3 && std::string_view(argv[2]) != "stats")) {
+        std::cerr << "Usage: " << argv[0] << " <archive> [stats]\n";
+        return 1;
+    }
+    try {
+        const archive::reader games(argv[1]);
+        archive::cursor records = games.records();
+        if (argc == 2) {
+            for (archive::game record; records.next(record);) {
+                print(std::cout, record);
+            }
+        } else { // decodes every move too, so the rate is the one of a full replay
+            std::array<uint64_t, RESULTS.size()> results{};
+            uint64_t count = 0, moves = 0, checksum = 0;
+            const auto start = std::chrono::steady_clock::now();
+            for (archive::game record; records.next(record); ++count) {
+                ++results[std::min<size_t>(record.result, RESULTS.size() - 1)];
+                moves += record.moveCount;
+                for (size_t i = 0; i < record.moveCount; ++i) {
+                    checksum += record.move(i);
+                }
+            }
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "games " << count << ", moves " << moves << ", " << games.bytes() << " bytes\n";
+            for (size_t i = 0; i < RESULTS.size(); ++i) {
+                std::cout << RESULTS[i] << ' ' << results[i] << '\n';
+            }
+            std::cout << "scan " << std::fixed << std::setprecision(3) << seconds * 1000 << " ms, "
+                      << static_cast<uint64_t>(count / std::max(seconds, 1e-9)) << " games/s (checksum "
+                      << checksum << ")\n";
+        }
+        if (!records.atEnd()) {
+            std::cerr << "Broken record at " << games.wholeSize() << '\n';
+            return 1;
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,361 @@
+#ifndef GAMEARCHIVE_H
+#define GAMEARCHIVE_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+// Finished games in one append-only file: MAGIC, then a record per game
+//   varint size of the rest, u8 board size, u8 win length, u8 result,
+//   varint start (ms since the epoch), varint duration (ms), u8 login size, the login of the first player,
+//   u8 login size, the login of the second player (empty - the bot),
+//   varint move count, the cells in the order of play packed LSB first with bitsPerMove() bits each.
+// Players are kept by login, the user ids differ between the processes of a cluster.
+// A 3x3 move takes 4 bits, so a whole classic game is about 20 bytes and the logins.
+namespace archive {
+    static constexpr std::string_view MAGIC = "TTTARC2\n";
+    static constexpr std::string_view OLDMAGIC = "TTTARC1\n"; // players by the user ids of one process
+
+    enum outcome : uint8_t {
+        FIRST_WON, // the player of the first move
+        SECOND_WON,
+        DRAW,
+        FIRST_LEFT, // disconnected, the other one wins
+        SECOND_LEFT
+    };
+
+    inline size_t bitsPerMove(size_t boardSize) {
+        return std::max<size_t>(1, std::bit_width(boardSize * boardSize - 1));
+    }
+
+    struct game {
+        uint8_t boardSize = 3;
+        uint8_t winLength = 3;
+        outcome result = DRAW;
+        uint64_t startedAt = 0; // ms since the epoch
+        uint64_t duration = 0; // ms
+        std::string_view players[2]; // logins, the first mover first, empty - the bot
+        uint32_t moveCount = 0;
+        const uint8_t *packed = nullptr; // moves of a read record, they and the logins point into the mapped file
+
+        [[nodiscard]] size_t move(size_t i) const { // cell of the i-th move
+            const size_t bits = bitsPerMove(boardSize);
+            size_t cell = 0;
+            for (size_t done = 0, pos = i * bits; done < bits;) {
+                const size_t shift = pos & 7, take = std::min(bits - done, 8 - shift);
+                cell |= static_cast<size_t>((packed[pos >> 3] >> shift) & ((1u << take) - 1)) << done;
+                done += take;
+                pos += take;
+            }
+            return cell;
+        }
+    };
+
+    inline uint8_t *putVarint(uint8_t *out, uint64_t value) { // returns the end of the written bytes
+        for (; value >= 0x80; value >>= 7) {
+            *out++ = static_cast<uint8_t>((value & 0x7F) | 0x80);
+        }
+        *out++ = static_cast<uint8_t>(value);
+        return out;
+    }
+
+    inline bool getVarint(const uint8_t *&pos, const uint8_t *end, uint64_t &value) {
+        value = 0;
+        for (int shift = 0; pos < end && shift < 64; shift += 7) {
+            const uint8_t byte = *pos++;
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    inline size_t varintSize(uint64_t value) {
+        return 1 + (std::bit_width(value) - (value != 0)) / 7;
+    }
+
+    // the whole record of a game with moves, appended to out without a temporary buffer
+    inline void encode(std::string &out, const game &record, std::span<const uint16_t> moves) {
+        const std::string_view players[2] = {record.players[0].substr(0, UINT8_MAX),
+                                             record.players[1].substr(0, UINT8_MAX)};
+        const size_t bits = bitsPerMove(record.boardSize);
+        const size_t packedSize = (moves.size() * bits + 7) / 8;
+        const size_t size = 5 + varintSize(record.startedAt) + varintSize(record.duration) + players[0].size() +
+                            players[1].size() + varintSize(moves.size()) + packedSize;
+        const size_t start = out.size();
+        out.resize(start + varintSize(size) + size);
+        auto *at = reinterpret_cast<uint8_t *>(out.data() + start);
+        at = putVarint(at, size);
+        *at++ = record.boardSize;
+        *at++ = record.winLength;
+        *at++ = record.result;
+        at = putVarint(putVarint(at, record.startedAt), record.duration);
+        for (std::string_view login: players) {
+            *at++ = static_cast<uint8_t>(login.size());
+            at = std::copy(login.begin(), login.end(), at);
+        }
+        at = putVarint(at, moves.size());
+        std::memset(at, 0, packedSize);
+        for (size_t i = 0, pos = 0; i < moves.size(); ++i, pos += bits) { // at most 16 bits in 3 bytes
+            const uint32_t shifted = static_cast<uint32_t>(moves[i]) << (pos & 7);
+            at[pos >> 3] |= static_cast<uint8_t>(shifted);
+            if ((pos & 7) + bits > 8) {
+                at[(pos >> 3) + 1] |= static_cast<uint8_t>(shifted >> 8);
+            }
+            if ((pos & 7) + bits > 16) {
+                at[(pos >> 3) + 2] |= static_cast<uint8_t>(shifted >> 16);
+            }
+        }
+    }
+
+    // walks the records of a buffer, stops at the first torn or broken one
+    class cursor {
+    private:
+        const uint8_t *pos;
+        const uint8_t *end;
+
+    public:
+        cursor(const uint8_t *begin, const uint8_t *end) : pos(begin), end(end) {}
+
+        bool next(game &record) {
+            const uint8_t *at = pos;
+            uint64_t size, value;
+            if (!getVarint(at, end, size) || size < 3 || size > static_cast<uint64_t>(end - at)) {
+                return false;
+            }
+            const uint8_t *recordEnd = at + size;
+            record.boardSize = at[0];
+            record.winLength = at[1];
+            record.result = static_cast<outcome>(at[2]);
+            at += 3;
+            if (record.boardSize == 0 || !getVarint(at, recordEnd, record.startedAt) ||
+                !getVarint(at, recordEnd, record.duration)) {
+                return false;
+            }
+            for (std::string_view &login: record.players) {
+                if (at == recordEnd || *at >= recordEnd - at) {
+                    return false;
+                }
+                login = {reinterpret_cast<const char *>(at + 1), *at};
+                at += 1 + *at;
+            }
+            if (!getVarint(at, recordEnd, value) ||
+                (value * bitsPerMove(record.boardSize) + 7) / 8 != static_cast<uint64_t>(recordEnd - at)) {
+                return false;
+            }
+            record.moveCount = static_cast<uint32_t>(value);
+            record.packed = at;
+            pos = recordEnd;
+            return true;
+        }
+
+        [[nodiscard]] const uint8_t *position() const { // after the last whole record
+            return pos;
+        }
+
+        [[nodiscard]] bool atEnd() const { // false after a torn or broken record
+            return pos == end;
+        }
+    };
+
+    // maps the archive read-only, records are decoded in place, so a scan is as fast as the page cache
+    class reader {
+    private:
+        void *mapping = MAP_FAILED;
+        size_t size = 0;
+
+        void unmap() {
+            if (mapping != MAP_FAILED) {
+                munmap(mapping, size);
+                mapping = MAP_FAILED;
+            }
+        }
+
+    public:
+        explicit reader(const std::string &path) {
+            int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat info{};
+            if (fd < 0 || fstat(fd, &info) < 0) {
+                if (fd >= 0) {
+                    close(fd);
+                }
+                throw std::invalid_argument("Can't open archive: " + path);
+            }
+            size = info.st_size;
+            if (size > 0) {
+                mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            }
+            close(fd);
+            if (size > 0 && mapping == MAP_FAILED) {
+                throw std::invalid_argument("Can't map archive: " + path);
+            }
+            if (size < MAGIC.size() || memcmp(mapping, MAGIC.data(), MAGIC.size()) != 0) {
+                unmap();
+                throw std::invalid_argument("Not a game archive: " + path);
+            }
+            madvise(mapping, size, MADV_SEQUENTIAL);
+        }
+
+        reader(const reader &) = delete;
+
+        reader &operator=(const reader &) = delete;
+
+        ~reader() {
+            unmap();
+        }
+
+        [[nodiscard]] cursor records() const {
+            const auto *begin = static_cast<const uint8_t *>(mapping);
+            return {begin + MAGIC.size(), begin + size};
+        }
+
+        [[nodiscard]] size_t bytes() const {
+            return size;
+        }
+
+        [[nodiscard]] size_t wholeSize() const { // bytes up to the end of the last whole record
+            cursor all = records();
+            for (game record; all.next(record);) {}
+            return all.position() - static_cast<const uint8_t *>(mapping);
+        }
+    };
+
+    // append() only encodes the game into a buffer, a background thread writes the buffer in batches,
+    // so a reactor never waits for the disk
+    class writer {
+    private:
+        std::string path;
+        int fd = -1;
+        off_t whole = 0; // end of the last batch written in full, the file is cut back to it after a failure
+        bool isTorn = false; // a batch failed after whole
+
+        std::mutex mutex; // guards pending and isActive
+        std::condition_variable signal;
+        std::string pending;
+        bool isActive = true;
+        std::thread thread;
+
+        static const size_t BATCH = 64 * 1024; // bytes that wake the writer before the interval
+        static constexpr std::chrono::seconds INTERVAL{1};
+
+        void openFile() {
+            fd = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                throw std::invalid_argument("Can't open archive: " + path);
+            }
+        }
+
+        void repair() { // a new file gets the magic, a torn record of a crash is cut off
+            struct stat info{};
+            char magic[MAGIC.size()] = {};
+            if (fstat(fd, &info) < 0 || (info.st_size > 0 && pread(fd, magic, sizeof(magic), 0) < 0)) {
+                throw std::invalid_argument("Can't read archive: " + path);
+            }
+            if (std::string_view(magic, sizeof(magic)) == OLDMAGIC) { // can't take the new records, kept aside
+                const std::string old = path + ".1";
+                if (rename(path.c_str(), old.c_str()) < 0) {
+                    throw std::invalid_argument("Can't move the old archive aside: " + path);
+                }
+                std::cerr << "The archive of the old format is moved to " << old << std::endl;
+                close(fd);
+                openFile();
+                info.st_size = 0;
+            }
+            if (info.st_size == 0) {
+                writeAll(MAGIC);
+                whole = static_cast<off_t>(MAGIC.size());
+                return;
+            }
+            whole = static_cast<off_t>(reader(path).wholeSize()); // throws when it isn't an archive
+            if (whole != info.st_size && ftruncate(fd, whole) < 0) {
+                throw std::invalid_argument("Can't repair archive: " + path);
+            }
+        }
+
+        void writeAll(std::string_view data) {
+            for (size_t written = 0; written < data.size();) {
+                ssize_t result = write(fd, data.data() + written, data.size() - written);
+                if (result < 0 && errno != EINTR) {
+                    throw std::invalid_argument("Can't write archive: " + path);
+                }
+                written += result > 0 ? result : 0;
+            }
+        }
+
+        void writeLoop() {
+            std::string batch;
+            std::unique_lock lock(mutex);
+            while (isActive || !pending.empty()) {
+                signal.wait_for(lock, INTERVAL, [this] { return !isActive || pending.size() >= BATCH; });
+                batch.swap(pending);
+                lock.unlock();
+                try {
+                    // a failed write may leave a torn record, later batches are never appended to it
+                    if (isTorn && ftruncate(fd, whole) < 0) {
+                        throw std::invalid_argument("Can't cut a torn batch off archive: " + path);
+                    }
+                    isTorn = true;
+                    writeAll(batch);
+                    whole += static_cast<off_t>(batch.size());
+                    isTorn = false;
+                } catch (const std::exception &e) { // games of the batch are lost, the server goes on
+                    std::cerr << e.what() << std::endl;
+                }
+                batch.clear();
+                lock.lock();
+            }
+        }
+
+    public:
+        explicit writer(std::string path) : path(std::move(path)) {
+            openFile();
+            repair();
+            thread = std::thread(&writer::writeLoop, this);
+        }
+
+        writer(const writer &) = delete;
+
+        writer &operator=(const writer &) = delete;
+
+        ~writer() { // writes every buffered game
+            {
+                std::lock_guard lock(mutex);
+                isActive = false;
+            }
+            signal.notify_one();
+            thread.join();
+            close(fd);
+        }
+
+        void append(const game &record, std::span<const uint16_t> moves) {
+            bool isFull;
+            {
+                std::lock_guard lock(mutex);
+                encode(pending, record, moves);
+                isFull = pending.size() >= BATCH;
+            }
+            if (isFull) {
+                signal.notify_one();
+            }
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,370 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <functional>
+#include <algorithm>
+#include <numeric>
+#include <ctime>
+
+#include "tictactoe.h"
+#include "gameSession.h"
+#include "sessionPool.h"
+#include "logger.h"
+#include "userStore.h"
+#include "binary.h"
+#include "gameArchive.h"
+#include "timerWheel.h"
+
+// Microbenchmarks of the hot paths, the results are printed as JSON to compare builds:
+//   ./bench > before.json, ./bench engine > engine.json - only the names with "engine"
+// Every benchmark is calibrated to run at least MINTIME, then repeated and the median is taken.
+namespace TicTacToeBench {
+
+    using clock = std::chrono::steady_clock;
+
+    static const std::chrono::milliseconds MINTIME{100};
+    static const size_t REPEATS = 5;
+
+    template<typename T>
+    inline void keep(const T &value) { // the compiler must not throw away the benchmarked code
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    struct result {
+        std::string name;
+        uint64_t operations; // in one repeat
+        double nsPerOp; // median of the repeats
+    };
+
+    class benchSuite {
+    private:
+        // body(n) does about n operations and returns how many it did
+        using body = std::function<uint64_t(uint64_t)>;
+
+        std::string filter;
+        std::vector<result> results;
+        std::mt19937_64 rng{42}; // the same inputs every run
+
+        static double run(const body &bench, uint64_t n, uint64_t &done) {
+            const auto start = clock::now();
+            done = bench(n);
+            return std::chrono::duration<double, std::nano>(clock::now() - start).count();
+        }
+
+        void measure(const std::string &name, const body &bench) {
+            if (name.find(filter) == std::string::npos) {
+                return;
+            }
+            std::cerr << name << "..." << std::endl;
+            uint64_t n = 1, done = 0;
+            // a body with a fixed amount of work returns less than asked, bigger n wouldn't take longer
+            while (run(bench, n, done) < std::chrono::duration<double, std::nano>(MINTIME).count() && done >= n) {
+                n *= 2;
+            }
+            std::vector<double> perOp;
+            for (size_t i = 0; i < REPEATS; ++i) {
+                const double time = run(bench, n, done);
+                perOp.push_back(time / static_cast<double>(std::max<uint64_t>(done, 1)));
+            }
+            std::sort(perOp.begin(), perOp.end());
+            results.push_back({name, done, perOp[REPEATS / 2]});
+        }
+
+        // random orders of all cells, a game is played until somebody wins
+        std::vector<std::vector<size_t>> randomGames(size_t cells, size_t count) {
+            std::vector<std::vector<size_t>> games(count, std::vector<size_t>(cells * cells));
+            for (auto &game: games) {
+                std::iota(game.begin(), game.end(), 0);
+                std::shuffle(game.begin(), game.end(), rng);
+            }
+            return games;
+        }
+
+        void benchEngine() {
+            for (auto [cells, winLength]: {std::pair<size_t, size_t>{3, 3}, {7, 5}, {15, 5}, {19, 5}}) {
+                const auto games = randomGames(cells, 64);
+                measure("engine/setCell+isWon/" + std::to_string(cells) + "x" + std::to_string(winLength),
+                        [&, cells, winLength](uint64_t n) {
+                            TicTacToe board(cells, winLength);
+                            uint64_t moves = 0;
+                            for (size_t game = 0; moves < n; ++game) {
+                                board.clear();
+                                for (size_t cell: games[game % games.size()]) {
+                                    board.setCell(cell);
+                                    ++moves;
+                                    if (board.isWon() || board.isDraw()) {
+                                        break;
+                                    }
+                                }
+                            }
+                            keep(board.getMoveCount());
+                            return moves;
+                        });
+            }
+        }
+
+        void benchSessions() {
+            measure("session/gameSession.restart/3x3", [](uint64_t n) {
+                gameSession session(3, 3);
+                for (uint64_t i = 0; i < n; ++i) {
+                    session.addUser(static_cast<int>(i));
+                    session.addUser(static_cast<int>(i + 1));
+                    session.setCell(i % 9);
+                    session.restart();
+                }
+                keep(session.getMoveCount());
+                return n;
+            });
+            for (size_t cells: {3, 15}) {
+                measure("session/sessionPool.acquire+release/" + std::to_string(cells) + "x" + std::to_string(cells),
+                        [cells](uint64_t n) {
+                            sessionPool pool(cells, cells == 3 ? 3 : 5, 1024);
+                            std::vector<size_t> active;
+                            for (uint64_t i = 0; i < n; ++i) { // a few games at a time, like a busy reactor
+                                if (active.size() == 512) {
+                                    pool.release(active[i % active.size()]);
+                                    active[i % active.size()] = pool.acquire();
+                                } else {
+                                    active.push_back(pool.acquire());
+                                }
+                            }
+                            keep(pool.size());
+                            return n;
+                        });
+            }
+        }
+
+        void benchLogger() {
+            measure("logger/log", [](uint64_t n) { // until the writer has put everything into the file
+                Logger log("bench.log");
+                for (uint64_t i = 0; i < n; ++i) {
+                    log.log(Logger::INFO, "Got message: put 4 from 17");
+                }
+                return n;
+            });
+            measure("logger/LOGF", [](uint64_t n) {
+                Logger log("bench.log");
+                const std::string_view message = "put 4";
+                for (uint64_t i = 0; i < n; ++i) {
+                    LOGF(log, INFO, "Got message: {} from {}", message, i);
+                }
+                return n;
+            });
+            measure("logger/LOGF.binary", [](uint64_t n) {
+                Logger log("bench.log");
+                log.setBinary("bench.log.bin");
+                const std::string_view message = "put 4";
+                for (uint64_t i = 0; i < n; ++i) {
+                    LOGF(log, INFO, "Got message: {} from {}", message, i);
+                }
+                return n;
+            });
+        }
+
+        void benchDatabase() {
+            const size_t USERS = 100000;
+            userStore db;
+            std::vector<std::string> logins, strangers;
+            for (size_t i = 0; i < USERS; ++i) {
+                logins.push_back("user" + std::to_string(rng()));
+                strangers.push_back("guest" + std::to_string(rng()));
+                db.insert(logins.back(), "password");
+            }
+            std::shuffle(logins.begin(), logins.end(), rng);
+            measure("db/find.hit/100k", [&](uint64_t n) {
+                size_t found = 0;
+                for (uint64_t i = 0; i < n; ++i) {
+                    found += db.find(logins[i % USERS]) != nullptr;
+                }
+                keep(found);
+                return n;
+            });
+            measure("db/find.miss/100k", [&](uint64_t n) {
+                size_t found = 0;
+                for (uint64_t i = 0; i < n; ++i) {
+                    found += db.find(strangers[i % USERS]) != nullptr;
+                }
+                keep(found);
+                return n;
+            });
+            measure("db/insert/100k", [&](uint64_t n) { // into a new table, so the growth is counted too
+                userStore fresh;
+                const uint64_t count = std::min<uint64_t>(n, USERS);
+                for (uint64_t i = 0; i < count; ++i) {
+                    fresh.insert(logins[i], "password");
+                }
+                keep(fresh.size());
+                return count;
+            });
+        }
+
+        void benchProtocol() {
+            std::vector<std::pair<std::string, std::string>> requests{
+                    {"log", "log someUser somePassword"},
+                    {"reg", "reg someUser somePassword"},
+                    {"put", "put 112"}
+            };
+            for (auto &[command, text]: requests) {
+                std::string binary;
+                protocol::requestToBinary(text, binary);
+                for (auto &[encoding, message]: {std::pair<std::string, std::string>{"text", text}, {"binary", binary}}) {
+                    measure("protocol/parse." + command + "/" + encoding, [&message](uint64_t n) {
+                        protocol::request request;
+                        uint64_t valid = 0;
+                        for (uint64_t i = 0; i < n; ++i) {
+                            std::string_view view = message;
+                            keep(view);
+                            valid += protocol::parseRequest(view, request);
+                            keep(request);
+                        }
+                        keep(valid);
+                        return n;
+                    });
+                }
+            }
+            measure("protocol/frameBuffer.next", [](uint64_t n) { // many small frames in one read
+                std::string stream;
+                for (int i = 0; i < 64; ++i) {
+                    protocol::appendFrame(stream, "put 112");
+                }
+                protocol::frameBuffer inbox;
+                uint64_t frames = 0;
+                while (frames < n) {
+                    memcpy(inbox.writePtr(), stream.data(), stream.size());
+                    inbox.commit(stream.size());
+                    for (std::string_view payload; inbox.next(payload); ++frames) {
+                        keep(payload);
+                    }
+                }
+                return frames;
+            });
+        }
+
+        void benchArchive() {
+            const auto games = randomGames(3, 64);
+            archive::game record;
+            record.startedAt = 1700000000000;
+            record.duration = 5000;
+            record.players[0] = "player12345";
+            record.players[1] = "player67890";
+            std::vector<std::vector<uint16_t>> moves;
+            for (const auto &game: games) { // the moves until the end of the game
+                TicTacToe board(3, 3);
+                moves.emplace_back();
+                for (size_t cell: game) {
+                    board.setCell(cell);
+                    moves.back().push_back(static_cast<uint16_t>(cell));
+                    if (board.isWon() || board.isDraw()) {
+                        break;
+                    }
+                }
+            }
+            measure("archive/encode/3x3", [&](uint64_t n) {
+                std::string out;
+                for (uint64_t i = 0; i < n; ++i) {
+                    if (out.size() > (1 << 20)) {
+                        out.clear();
+                    }
+                    archive::encode(out, record, moves[i % moves.size()]);
+                }
+                keep(out.size());
+                return n;
+            });
+            std::string data;
+            for (size_t i = 0; i < 100000; ++i) {
+                archive::encode(data, record, moves[i % moves.size()]);
+            }
+            measure("archive/scan+replay/3x3", [&data](uint64_t n) { // every move is decoded
+                uint64_t count = 0, checksum = 0;
+                const auto *begin = reinterpret_cast<const uint8_t *>(data.data());
+                while (count < n) {
+                    archive::cursor records(begin, begin + data.size());
+                    for (archive::game game; records.next(game); ++count) {
+                        for (size_t i = 0; i < game.moveCount; ++i) {
+                            checksum += game.move(i);
+                        }
+                    }
+                }
+                keep(checksum);
+                return count;
+            });
+        }
+
+        void benchTimers() {
+            const size_t TIMERS = 10000; // a full reactor
+            std::vector<std::chrono::milliseconds> delays(1 << 16);
+            for (auto &delay: delays) { // from a move clock to an idle timeout
+                delay = std::chrono::milliseconds(rng() % 600000);
+            }
+            measure("timers/schedule/10k", [&](uint64_t n) { // every request moves the deadline of its client
+                const auto start = clock::now();
+                timerWheel timers(TIMERS, start);
+                for (uint64_t i = 0; i < n; ++i) {
+                    timers.schedule(i % TIMERS, start + delays[i & (delays.size() - 1)]);
+                }
+                keep(timers.size());
+                return n;
+            });
+            measure("timers/advance+fire/10k", [&](uint64_t n) { // the fired ones are scheduled again
+                const auto start = clock::now();
+                timerWheel timers(TIMERS, start);
+                for (size_t id = 0; id < TIMERS; ++id) {
+                    timers.schedule(id, start + delays[id] / 60);
+                }
+                uint64_t fired = 0;
+                auto now = start;
+                while (fired < n) {
+                    now += std::chrono::milliseconds(1);
+                    timers.advance(now, [&](size_t id) {
+                        timers.schedule(id, now + delays[fired++ & (delays.size() - 1)] / 60);
+                    });
+                }
+                return fired;
+            });
+        }
+
+        void print() const {
+            const std::time_t now = std::time(nullptr);
+            std::cout << "{\n  \"context\": {\n";
+            std::cout << "    \"date\": \"" << Logger::timeStamp(now) << "\",\n";
+            std::cout << "    \"compiler\": \"" << __VERSION__ << "\",\n";
+#ifdef NDEBUG
+            std::cout << "    \"optimized\": true\n";
+#else
+            std::cout << "    \"optimized\": false\n";
+#endif
+            std::cout << "  },\n  \"benchmarks\": [\n";
+            for (size_t i = 0; i < results.size(); ++i) {
+                const result &current = results[i];
+                std::cout << "    {\"name\": \"" << current.name << "\", \"operations\": " << current.operations
+                          << ", \"ns_per_op\": " << current.nsPerOp
+                          << ", \"ops_per_sec\": " << static_cast<uint64_t>(1e9 / current.nsPerOp) << "}"
+                          << (i + 1 < results.size() ? ",\n" : "\n");
+            }
+            std::cout << "  ]\n}" << std::endl;
+        }
+
+    public:
+        explicit benchSuite(std::string filter) : filter(std::move(filter)) {}
+
+        void runAll() {
+            benchEngine();
+            benchSessions();
+            benchLogger();
+            benchDatabase();
+            benchProtocol();
+            benchArchive();
+            benchTimers();
+            print();
+        }
+    };
+}
+
+int main(int argc, char **argv) {
+    TicTacToeBench::benchSuite suite(argc > 1 ? argv[1] : "");
+    suite.runAll();
+    return 0;
+}
@@ -0,0 +1,119 @@
+#ifndef BOTWORKER_H
+#define BOTWORKER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "tictactoe.h"
+#include "searcher.h"
+#include "mcts.h"
+
+// Threads that search bot moves off the event loop, a few so one long search doesn't hold the other bot games.
+// The owner posts jobs, gets notified through the callback and takes the results in its own thread.
+// Boards that fit in 64 cells are searched with alpha-beta, bigger ones with parallel MCTS.
+// Every thread has its own searcher and tree, made with its first job of that kind.
+class botWorker {
+public:
+    struct job {
+        size_t session;
+        uint64_t generation; // the session could be restarted while the bot was thinking
+        TicTacToe board;
+    };
+
+    struct result {
+        size_t session;
+        uint64_t generation;
+        size_t cell;
+        mcts::stats stats; // playouts of MCTS, zero for alpha-beta
+    };
+
+private:
+    std::chrono::milliseconds budget; // time for one move
+    std::function<void()> notify;
+
+    size_t treeThreads;
+    std::deque<job> jobs;
+    std::vector<result> results;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool isActive = true;
+    std::vector<std::thread> threads;
+
+    void run() {
+        std::unique_ptr<searcher> engine;
+        std::unique_ptr<mcts> tree;
+        std::unique_lock lock(mutex);
+        while (true) {
+            cv.wait(lock, [this] { return !isActive || !jobs.empty(); });
+            if (!isActive) {
+                return;
+            }
+            job current = std::move(jobs.front());
+            jobs.pop_front();
+            lock.unlock();
+
+            mcts::stats stats{};
+            size_t cell;
+            if (current.board.getFieldSize() > 64) {
+                if (!tree) {
+                    tree = std::make_unique<mcts>(treeThreads);
+                }
+                cell = tree->bestMove(current.board, budget, &stats);
+            } else {
+                if (!engine) {
+                    engine = std::make_unique<searcher>();
+                }
+                cell = engine->bestMove(current.board, budget);
+            }
+
+            lock.lock();
+            results.push_back({current.session, current.generation, cell, stats});
+            notify();
+        }
+    }
+
+public:
+    botWorker(std::chrono::milliseconds budget, size_t workers, size_t treeThreads, std::function<void()> notify) :
+            budget(budget), notify(std::move(notify)), treeThreads(treeThreads) {
+        if (workers == 0) {
+            throw std::invalid_argument("A bot needs at least one worker");
+        }
+        for (size_t i = 0; i < workers; ++i) {
+            threads.emplace_back(&botWorker::run, this);
+        }
+    }
+
+    ~botWorker() {
+        {
+            std::lock_guard lock(mutex);
+            isActive = false;
+        }
+        cv.notify_all();
+        for (auto &th : threads) {
+            th.join();
+        }
+    }
+
+    void post(job next) {
+        {
+            std::lock_guard lock(mutex);
+            jobs.push_back(std::move(next));
+        }
+        cv.notify_one();
+    }
+
+    std::vector<result> take() {
+        std::lock_guard lock(mutex);
+        return std::exchange(results, {});
+    }
+};
+
+#endif
@@ -0,0 +1,296 @@
+#ifndef MCTS_H
+#define MCTS_H
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "tictactoe.h"
+#include "moveGen.h"
+
+// Tree-parallel Monte Carlo Tree Search.
+// All threads walk one shared tree, statistics of the nodes are atomics, so there are no locks on the way.
+// A thread adds a virtual loss to every node of its path, so the other threads choose different branches
+// until the playout result is written back.
+class mcts {
+public:
+    struct stats {
+        uint64_t playouts;
+        uint64_t micros;
+        size_t threads;
+
+        [[nodiscard]] double playoutsPerSecond() const {
+            return micros ? playouts * 1e6 / static_cast<double>(micros) : 0;
+        }
+    };
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr uint32_t NONE = UINT32_MAX;
+    static constexpr double EXPLORATION = 1.4;
+
+    enum state : uint8_t {
+        LEAF,
+        EXPANDING,
+        EXPANDED
+    };
+
+    struct node {
+        std::atomic<uint32_t> visits{0};
+        std::atomic<uint32_t> score{0}; // 2 per win and 1 per draw of the player who made the move
+        std::atomic<uint32_t> virtualLoss{0};
+        std::atomic<uint8_t> expansion{LEAF};
+        uint32_t firstChild = NONE;
+        uint32_t childCount = 0;
+        uint32_t move = NONE;
+        uint8_t player = 0; // getTurn() value of the player who made the move
+    };
+
+    size_t threadCount;
+    std::unique_ptr<node[]> nodes; // preallocated tree, root is nodes[0]
+    size_t capacity;
+    std::atomic<uint32_t> used{0};
+
+    // search parameters shared with the workers
+    const TicTacToe *root = nullptr;
+    clock::time_point deadline;
+    std::atomic<uint64_t> playouts{0};
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable cv;
+    uint64_t round = 0; // every search is a new round for the workers
+    size_t running = 0;
+    bool isActive = true;
+
+    uint32_t allocate(uint32_t count) {
+        uint32_t first = used.fetch_add(count, std::memory_order_relaxed);
+        if (first + count > capacity) { // tree is full, the leaf stays a leaf
+            return NONE;
+        }
+        return first;
+    }
+
+    void reset(const TicTacToe &board) {
+        for (uint32_t i = 0, size = std::min<uint32_t>(used, capacity); i < size; ++i) {
+            nodes[i].visits.store(0, std::memory_order_relaxed);
+            nodes[i].score.store(0, std::memory_order_relaxed);
+            nodes[i].virtualLoss.store(0, std::memory_order_relaxed);
+            nodes[i].expansion.store(LEAF, std::memory_order_relaxed);
+        }
+        used = 1;
+        nodes[0].firstChild = NONE;
+        nodes[0].childCount = 0;
+        nodes[0].move = NONE;
+        nodes[0].player = !board.getTurn();
+        playouts = 0;
+    }
+
+    // children are published by the release store of EXPANDED
+    void expand(node &leaf, const TicTacToe &board, std::vector<size_t> &moves) {
+        uint8_t expected = LEAF;
+        if (!leaf.expansion.compare_exchange_strong(expected, EXPANDING, std::memory_order_acq_rel)) {
+            return; // another thread is already here
+        }
+        nearbyMoves(board, moves);
+        uint32_t first = moves.empty() ? NONE : allocate(moves.size());
+        if (first == NONE) {
+            leaf.expansion.store(LEAF, std::memory_order_release);
+            return;
+        }
+        for (size_t i = 0; i < moves.size(); ++i) {
+            node &child = nodes[first + i];
+            child.firstChild = NONE;
+            child.childCount = 0;
+            child.move = moves[i];
+            child.player = board.getTurn();
+        }
+        leaf.firstChild = first;
+        leaf.childCount = moves.size();
+        leaf.expansion.store(EXPANDED, std::memory_order_release);
+    }
+
+    uint32_t select(const node &parent, std::mt19937_64 &rng) {
+        const double total = parent.visits.load(std::memory_order_relaxed) +
+                             parent.virtualLoss.load(std::memory_order_relaxed);
+        const double logTotal = std::log(total + 1);
+        uint32_t best = parent.firstChild;
+        double bestValue = -1;
+        for (uint32_t i = parent.firstChild; i < parent.firstChild + parent.childCount; ++i) {
+            const node &child = nodes[i];
+            const double visits = child.visits.load(std::memory_order_relaxed) +
+                                  child.virtualLoss.load(std::memory_order_relaxed);
+            // unvisited children first, ties are broken randomly
+            double value = visits == 0 ? 10 + static_cast<double>(rng() & 1023) / 1024
+                                       : child.score.load(std::memory_order_relaxed) / (2 * visits) +
+                                         EXPLORATION * std::sqrt(logTotal / visits);
+            if (value > bestValue) {
+                bestValue = value;
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    // random game from the position, returns the winner's getTurn() value or -1 for a draw
+    static int rollout(TicTacToe &board, std::vector<size_t> &freeCells, std::mt19937_64 &rng) {
+        freeCells.clear();
+        for (size_t cell = 0; cell < board.getFieldSize(); ++cell) {
+            if (board.isFree(cell)) {
+                freeCells.push_back(cell);
+            }
+        }
+        while (!freeCells.empty()) {
+            size_t pick = rng() % freeCells.size();
+            std::swap(freeCells[pick], freeCells.back());
+            const bool player = board.getTurn();
+            board.setCell(freeCells.back());
+            freeCells.pop_back();
+            if (board.isWon()) {
+                return player;
+            }
+        }
+        return -1;
+    }
+
+    void playout(std::vector<uint32_t> &path, std::vector<size_t> &buffer, std::mt19937_64 &rng) {
+        TicTacToe board = *root;
+        path.assign(1, 0);
+        nodes[0].virtualLoss.fetch_add(1, std::memory_order_relaxed);
+
+        int winner = -2; // unknown yet
+        while (true) {
+            node &current = nodes[path.back()];
+            if (current.expansion.load(std::memory_order_acquire) != EXPANDED) {
+                if (current.visits.load(std::memory_order_relaxed) > 0) {
+                    expand(current, board, buffer);
+                }
+                if (current.expansion.load(std::memory_order_acquire) != EXPANDED) {
+                    break;
+                }
+            }
+            if (current.childCount == 0) {
+                break;
+            }
+            uint32_t next = select(current, rng);
+            nodes[next].virtualLoss.fetch_add(1, std::memory_order_relaxed);
+            path.push_back(next);
+            board.setCell(nodes[next].move);
+            if (board.isWon()) {
+                winner = nodes[next].player;
+                break;
+            }
+            if (board.isDraw()) {
+                winner = -1;
+                break;
+            }
+        }
+        if (winner == -2) {
+            winner = rollout(board, buffer, rng);
+        }
+
+        for (uint32_t index: path) {
+            node &current = nodes[index];
+            current.score.fetch_add(winner == -1 ? 1 : winner == current.player ? 2 : 0,
+                                    std::memory_order_relaxed);
+            current.visits.fetch_add(1, std::memory_order_relaxed);
+            current.virtualLoss.fetch_sub(1, std::memory_order_relaxed);
+        }
+        playouts.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void work(size_t seed) {
+        std::mt19937_64 rng(seed);
+        std::vector<uint32_t> path;
+        std::vector<size_t> buffer;
+        uint64_t seen = 0;
+        std::unique_lock lock(mutex);
+        while (true) {
+            cv.wait(lock, [&] { return !isActive || round != seen; });
+            if (!isActive) {
+                return;
+            }
+            seen = round;
+            lock.unlock();
+
+            while (clock::now() < deadline) {
+                for (int i = 0; i < 64; ++i) { // check the clock once per batch
+                    playout(path, buffer, rng);
+                }
+            }
+
+            lock.lock();
+            if (--running == 0) {
+                cv.notify_all();
+            }
+        }
+    }
+
+public:
+    explicit mcts(size_t threads = std::max(1u, std::thread::hardware_concurrency()), size_t capacity = 1 << 20) :
+            threadCount(std::max<size_t>(threads, 1)), nodes(new node[capacity]), capacity(capacity) {
+        std::random_device seed;
+        for (size_t i = 0; i < threadCount; ++i) {
+            workers.emplace_back(&mcts::work, this, seed());
+        }
+    }
+
+    ~mcts() {
+        {
+            std::lock_guard lock(mutex);
+            isActive = false;
+        }
+        cv.notify_all();
+        for (auto &worker: workers) {
+            worker.join();
+        }
+    }
+
+    // the most visited move after the budget, the board must have a free cell
+    size_t bestMove(const TicTacToe &board, std::chrono::milliseconds budget, stats *report = nullptr) {
+        const auto start = clock::now();
+        reset(board);
+        root = &board;
+        {
+            std::unique_lock lock(mutex);
+            deadline = start + budget;
+            running = threadCount;
+            ++round;
+            cv.notify_all();
+            cv.wait(lock, [this] { return running == 0; });
+        }
+
+        const node &top = nodes[0];
+        size_t best = NONE;
+        uint32_t bestVisits = 0;
+        if (top.expansion.load(std::memory_order_acquire) == EXPANDED) {
+            for (uint32_t i = top.firstChild; i < top.firstChild + top.childCount; ++i) {
+                if (best == NONE || nodes[i].visits > bestVisits) {
+                    bestVisits = nodes[i].visits;
+                    best = nodes[i].move;
+                }
+            }
+        }
+        if (best == NONE) { // no time for even one expansion
+            std::vector<size_t> moves;
+            nearbyMoves(board, moves);
+            best = moves.front();
+        }
+        if (report) {
+            *report = {playouts, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                    clock::now() - start).count()), threadCount};
+        }
+        return best;
+    }
+};
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef MOVEGEN_H
+#define MOVEGEN_H
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "tictactoe.h"
+
+// Free cells worth playing: every cell on small boards, only the neighbours of taken cells on big ones.
+// Big boards would be too wide to search otherwise.
+inline void nearbyMoves(const TicTacToe &board, std::vector<size_t> &out) {
+    out.clear();
+    const size_t cells = board.getCells(), fieldSize = board.getFieldSize();
+    if (board.getMoveCount() == 0 && fieldSize > 64) { // open in the center
+        out.push_back(fieldSize / 2);
+        return;
+    }
+    const bool everyCell = fieldSize <= 64;
+    for (size_t cell = 0; cell < fieldSize; ++cell) {
+        if (!board.isFree(cell)) {
+            continue;
+        }
+        bool near = everyCell;
+        const size_t row = cell / cells, col = cell % cells;
+        for (size_t r = row ? row - 1 : 0; !near && r <= std::min(row + 1, cells - 1); ++r) {
+            for (size_t c = col ? col - 1 : 0; !near && c <= std::min(col + 1, cells - 1); ++c) {
+                near = !board.isFree(r * cells + c);
+            }
+        }
+        if (near) {
+            out.push_back(cell);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,197 @@
+#ifndef SEARCHER_H
+#define SEARCHER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "tictactoe.h"
+#include "moveGen.h"
+
+// Negamax with alpha-beta pruning and iterative deepening.
+// Positions are cached in a transposition table keyed by a Zobrist hash of the stones and the side to move,
+// moves are ordered by the table's best move first and then by the history of cutoffs.
+class searcher {
+private:
+    using clock = std::chrono::steady_clock;
+
+    static const int WIN = 1'000'000;
+    static const int INF = 2 * WIN;
+
+    enum bound : uint8_t {
+        EXACT,
+        LOWER,
+        UPPER
+    };
+
+    struct entry {
+        uint64_t key;
+        int32_t value;
+        uint32_t move;
+        uint8_t depth;
+        bound type;
+    };
+
+    std::vector<entry> table; // size is a power of two
+    std::vector<uint64_t> zobrist; // [player * fieldSize + cell]
+    uint64_t sideKey = 0; // in the hash when 'X' moves, the table outlives games with either first mover
+    std::vector<uint32_t> history; // cutoffs made by every cell
+    std::vector<std::vector<size_t>> moves; // move lists for every ply, reused between searches
+    std::mt19937_64 random{20240131};
+
+    uint64_t hash = 0;
+    size_t nodes = 0;
+    bool stopped = false;
+    clock::time_point deadline;
+
+    void prepare(const TicTacToe &board) {
+        const size_t fieldSize = board.getFieldSize();
+        if (zobrist.size() != 2 * fieldSize) {
+            zobrist.resize(2 * fieldSize);
+            for (auto &key: zobrist) {
+                key = random();
+            }
+            sideKey = random();
+            history.assign(fieldSize, 0);
+            std::fill(table.begin(), table.end(), entry{});
+        }
+        if (moves.size() < fieldSize + 1) {
+            moves.resize(fieldSize + 1);
+        }
+        hash = board.getTurn() ? sideKey : 0;
+        for (size_t cell = 0; cell < fieldSize; ++cell) {
+            for (size_t player: {0, 1}) {
+                if (board.isOwnedBy(player, cell)) {
+                    hash ^= zobrist[player * fieldSize + cell];
+                }
+            }
+        }
+        nodes = 0;
+        stopped = false;
+    }
+
+    // moves worth searching, the table's move first and then by the history of cutoffs
+    void generate(const TicTacToe &board, std::vector<size_t> &out, uint32_t first) const {
+        nearbyMoves(board, out);
+        std::sort(out.begin(), out.end(), [&](size_t a, size_t b) {
+            if ((a == first) != (b == first)) {
+                return a == first;
+            }
+            return history[a] > history[b];
+        });
+    }
+
+    int negamax(TicTacToe &board, int depth, int alpha, int beta, size_t ply) {
+        if ((++nodes & 1023) == 0 && clock::now() >= deadline) {
+            stopped = true;
+        }
+        if (stopped || board.isDraw() || depth == 0) {
+            return 0;
+        }
+
+        const int alphaOrig = alpha;
+        entry &slot = table[hash & (table.size() - 1)];
+        uint32_t first = UINT32_MAX;
+        if (slot.key == hash) {
+            first = slot.move;
+            if (slot.depth >= depth) {
+                if (slot.type == EXACT ||
+                    (slot.type == LOWER && slot.value >= beta) ||
+                    (slot.type == UPPER && slot.value <= alpha)) {
+                    return slot.value;
+                }
+            }
+        }
+
+        auto &list = moves[ply];
+        generate(board, list, first);
+
+        int best = -INF;
+        size_t bestMove = list.front();
+        const size_t player = board.getTurn();
+        for (size_t i = 0; i < list.size(); ++i) {
+            const size_t cell = list[i];
+            board.setCell(cell);
+            hash ^= zobrist[player * board.getFieldSize() + cell] ^ sideKey;
+            // earlier wins are better, the move count keeps the score independent of the search root
+            int value = board.isWon() ? WIN - static_cast<int>(board.getMoveCount())
+                                      : -negamax(board, depth - 1, -beta, -alpha, ply + 1);
+            hash ^= zobrist[player * board.getFieldSize() + cell] ^ sideKey;
+            board.unsetCell(cell);
+            if (stopped) {
+                return 0;
+            }
+            if (value > best) {
+                best = value;
+                bestMove = cell;
+            }
+            alpha = std::max(alpha, value);
+            if (alpha >= beta) {
+                history[cell] += depth * depth;
+                break;
+            }
+        }
+
+        slot = {hash, best, static_cast<uint32_t>(bestMove), static_cast<uint8_t>(std::min(depth, 255)),
+                best <= alphaOrig ? UPPER : best >= beta ? LOWER : EXACT};
+        return best;
+    }
+
+public:
+    explicit searcher(size_t tableBits = 18) : table(size_t{1} << tableBits) {}
+
+    // the best move found before the budget runs out, the board must have a free cell
+    size_t bestMove(TicTacToe board, std::chrono::milliseconds budget) {
+        deadline = clock::now() + budget;
+        prepare(board);
+        auto &rootMoves = moves[0];
+        generate(board, rootMoves, UINT32_MAX);
+        size_t best = rootMoves.front();
+        if (rootMoves.size() == 1) {
+            return best;
+        }
+
+        const size_t player = board.getTurn();
+        const int maxDepth = static_cast<int>(board.getFieldSize() - board.getMoveCount());
+        for (int depth = 1; depth <= maxDepth; ++depth) {
+            int alpha = -INF;
+            size_t candidate = rootMoves.front();
+            for (const size_t cell: rootMoves) {
+                board.setCell(cell);
+                hash ^= zobrist[player * board.getFieldSize() + cell] ^ sideKey;
+                int value = board.isWon() ? WIN - static_cast<int>(board.getMoveCount())
+                                          : -negamax(board, depth - 1, -INF, -alpha, 1);
+                hash ^= zobrist[player * board.getFieldSize() + cell] ^ sideKey;
+                board.unsetCell(cell);
+                if (stopped) {
+                    break;
+                }
+                if (value > alpha) {
+                    alpha = value;
+                    candidate = cell;
+                }
+            }
+            if (stopped) { // unfinished iteration is not trusted
+                break;
+            }
+            best = candidate;
+            // search the best move first in the next iteration
+            std::rotate(rootMoves.begin(), std::find(rootMoves.begin(), rootMoves.end(), best),
+                        std::find(rootMoves.begin(), rootMoves.end(), best) + 1);
+            if (std::abs(alpha) >= WIN - static_cast<int>(board.getFieldSize())) { // result is known
+                break;
+            }
+        }
+        return best;
+    }
+
+    [[nodiscard]] size_t getNodes() const {
+        return nodes;
+    }
+};
+
+#endif
@@ -0,0 +1,207 @@
+#ifndef SESSIONCHECKPOINT_H
+#define SESSIONCHECKPOINT_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "gameArchive.h"
+
+// Games being played, saved by a reactor into its own memory-mapped file, so a restarted server lets the players
+// go on. The file has two halves written in turn, a crash in the middle of a write leaves the other one whole:
+//   half: MAGIC, u64 sequence, u64 payload size, u64 FNV-1a of the payload, the payload
+//   payload: u8 board size, u8 win length, then per game
+//     varint start (ms since the epoch), u8 turn before the first move, u8 bot side + 1,
+//     u8 login size, the login of the first mover, u8 login size, the login of the second one (empty - the bot),
+//     varint move count, varint cells in the order of play.
+namespace checkpoint {
+    static constexpr std::string_view MAGIC = "TTTCKP1\n";
+
+    struct game {
+        uint64_t startedAt = 0; // ms since the epoch
+        bool firstTurn = false; // getTurn() of the session before the first move
+        int8_t botSide = -1; // sessionPool::NOBOT for two players
+        std::string players[2]; // logins, the first mover first, empty - the bot
+        std::vector<uint16_t> moves; // of a read game
+    };
+
+    inline void begin(std::string &out, size_t boardSize, size_t winLength) {
+        out.push_back(static_cast<char>(boardSize));
+        out.push_back(static_cast<char>(winLength));
+    }
+
+    inline void putVarint(std::string &out, uint64_t value) {
+        uint8_t bytes[10];
+        out.append(reinterpret_cast<const char *>(bytes), archive::putVarint(bytes, value) - bytes);
+    }
+
+    inline void encode(std::string &out, const game &record, std::span<const uint16_t> moves) {
+        putVarint(out, record.startedAt);
+        out.push_back(static_cast<char>(record.firstTurn));
+        out.push_back(static_cast<char>(record.botSide + 1));
+        for (const std::string &login: record.players) {
+            out.push_back(static_cast<char>(login.size()));
+            out.append(login);
+        }
+        putVarint(out, moves.size());
+        for (uint16_t cell: moves) {
+            putVarint(out, cell);
+        }
+    }
+
+    // false at the end or on a broken game
+    inline bool decode(const uint8_t *&pos, const uint8_t *end, size_t cells, game &record) {
+        uint64_t value;
+        if (!archive::getVarint(pos, end, record.startedAt) || end - pos < 3) {
+            return false;
+        }
+        record.firstTurn = *pos++ != 0;
+        record.botSide = static_cast<int8_t>(*pos++ - 1);
+        for (std::string &login: record.players) {
+            const size_t size = pos < end ? *pos++ : 0;
+            if (static_cast<size_t>(end - pos) < size) {
+                return false;
+            }
+            login.assign(reinterpret_cast<const char *>(pos), size);
+            pos += size;
+        }
+        if (!archive::getVarint(pos, end, value) || value >= cells ||
+            (record.players[0].empty() && record.players[1].empty())) {
+            return false;
+        }
+        record.moves.resize(value);
+        for (uint16_t &cell: record.moves) {
+            if (!archive::getVarint(pos, end, value) || value >= cells) {
+                return false;
+            }
+            cell = static_cast<uint16_t>(value);
+        }
+        return true;
+    }
+
+    inline uint64_t checksum(std::string_view data) { // FNV-1a
+        uint64_t value = 14695981039346656037ull;
+        for (char c: data) {
+            value = (value ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+        }
+        return value;
+    }
+
+    static const size_t HEADERSIZE = MAGIC.size() + 24;
+
+    // games of the newest whole half, nothing when the file is missing, broken or of another board
+    inline std::vector<game> load(const std::string &path, size_t boardSize, size_t winLength) {
+        std::vector<game> games;
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat info{};
+        if (fd < 0 || fstat(fd, &info) < 0 || info.st_size < static_cast<off_t>(2 * HEADERSIZE)) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            return games;
+        }
+        const size_t size = info.st_size;
+        void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            return games;
+        }
+        const size_t half = size / 2;
+        std::string_view payload;
+        uint64_t newest = 0;
+        for (size_t start: {size_t{0}, half}) {
+            const char *at = static_cast<const char *>(mapping) + start;
+            uint64_t sequence, length, sum;
+            memcpy(&sequence, at + MAGIC.size(), 8);
+            memcpy(&length, at + MAGIC.size() + 8, 8);
+            memcpy(&sum, at + MAGIC.size() + 16, 8);
+            if (std::string_view(at, MAGIC.size()) == MAGIC && length <= half - HEADERSIZE && sequence > newest &&
+                checksum({at + HEADERSIZE, length}) == sum) {
+                newest = sequence;
+                payload = {at + HEADERSIZE, length};
+            }
+        }
+        if (payload.size() >= 2 && static_cast<uint8_t>(payload[0]) == boardSize &&
+            static_cast<uint8_t>(payload[1]) == winLength) {
+            const auto *pos = reinterpret_cast<const uint8_t *>(payload.data()) + 2;
+            const auto *end = reinterpret_cast<const uint8_t *>(payload.data() + payload.size());
+            for (game record; pos < end && decode(pos, end, boardSize * boardSize, record);) {
+                games.push_back(std::move(record));
+            }
+        }
+        munmap(mapping, size);
+        return games;
+    }
+
+    // the whole payload is copied into the mapping, the kernel writes the pages back, so a reactor never waits
+    // for the disk, and a killed process leaves its last checkpoint in the page cache
+    class writer {
+    private:
+        std::string path;
+        int fd = -1;
+        void *mapping = MAP_FAILED;
+        size_t half = 0; // bytes of a half with its header
+        uint64_t sequence = 0;
+
+        void resize(size_t newHalf) { // the next write goes to the new second half, the one at the start stays
+            if (mapping != MAP_FAILED) {
+                munmap(mapping, 2 * half);
+                mapping = MAP_FAILED;
+            }
+            if (ftruncate(fd, static_cast<off_t>(2 * newHalf)) < 0) {
+                throw std::invalid_argument("Can't resize checkpoint: " + path);
+            }
+            mapping = mmap(nullptr, 2 * newHalf, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (mapping == MAP_FAILED) {
+                throw std::invalid_argument("Can't map checkpoint: " + path);
+            }
+            half = newHalf;
+            sequence |= 1; // the next one is even, the second half
+        }
+
+    public:
+        explicit writer(std::string path) : path(std::move(path)) {
+            fd = open(this->path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                throw std::invalid_argument("Can't open checkpoint: " + this->path);
+            }
+            resize(4096);
+        }
+
+        writer(const writer &) = delete;
+
+        writer &operator=(const writer &) = delete;
+
+        ~writer() {
+            munmap(mapping, 2 * half);
+            close(fd);
+        }
+
+        void write(std::string_view payload) {
+            if (HEADERSIZE + payload.size() > half) {
+                resize(std::bit_ceil(HEADERSIZE + payload.size()));
+            }
+            ++sequence;
+            char *at = static_cast<char *>(mapping) + (sequence % 2 == 0 ? half : 0);
+            const uint64_t length = payload.size(), sum = checksum(payload);
+            memcpy(at + HEADERSIZE, payload.data(), payload.size());
+            memcpy(at + MAGIC.size() + 8, &length, 8);
+            memcpy(at + MAGIC.size() + 16, &sum, 8);
+            memcpy(at + MAGIC.size(), &sequence, 8);
+            memcpy(at, MAGIC.data(), MAGIC.size());
+            msync(at, HEADERSIZE + payload.size(), MS_ASYNC); // a half starts on a page
+        }
+    };
+}
+
+#endif
@@ -10,6 +10,8 @@
 #include <sstream>
 
 #include "logger.h"
+#include "frame.h"
+#include "binary.h"
 
 namespace TicTacToe {
     void getGameMessage();
@@ -19,14 +21,13 @@ namespace TicTacToe {
     class ClientSocket {
     private:
         std::unordered_map<std::string, std::string> configData; // container for config data
-        static const int BUFFERSIZE = 1024;
-
         // socket vars
         int client_fd;
         struct sockaddr_in servAddr{};
-        char buffer[BUFFERSIZE]{0};
+        protocol::frameBuffer inbox; // received bytes, may hold several messages or a part of one
 
         bool isActive = false; // socket state
+        bool isBinary = false; // Protocol=binary in the config, requests are translated to the binary encoding
 
         void readCfg() {
             logger.log(Logger::INFO, "Start loading the config.");
@@ -73,6 +74,7 @@ namespace TicTacToe {
             if (status < 0) {
                 throw std::invalid_argument("Connection Failed");
             }
+            isBinary = configData["PROTOCOL"] == "binary";
             isActive = true;
             std::cout << "Connected\n";
             logger.log(Logger::INFO, "Connected.");
@@ -82,17 +84,35 @@ namespace TicTacToe {
         }
 
         void sendMessage(const std::string &message) const {
-            send(client_fd, message.c_str(), strlen(message.c_str()), 0);
+            std::string request;
+            std::string frame = protocol::encodeFrame(
+                    isBinary && protocol::requestToBinary(message, request) ? request : message);
+            send(client_fd, frame.data(), frame.size(), 0);
             std::cout << "Send " << message << '\n';
             logger.log(Logger::DEBUG, "Send " + message);
         }
 
         std::string getMessage() {
-            memset(buffer, 0, BUFFERSIZE);
-            read(client_fd, buffer, BUFFERSIZE);
-            std::cout << "Get " << buffer << std::endl;
-            logger.log(Logger::DEBUG, "Get " + std::string(buffer));
-            return buffer;
+            std::string_view message;
+            while (!inbox.next(message)) { // read until a whole message is received
+                ssize_t valread = read(client_fd, inbox.writePtr(), inbox.writeSize());
+                if (valread < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (valread <= 0 || inbox.isBroken()) { // connection is lost
+                    isActive = false;
+                    logger.log(Logger::ERROR, "Connection lost.");
+                    return "shutdown";
+                }
+                inbox.commit(valread);
+            }
+            std::string text(message);
+            if (protocol::isBinary(message) && !protocol::messageToText(message, text)) {
+                logger.log(Logger::WARNING, "Broken binary message.");
+            }
+            std::cout << "Get " << text << std::endl;
+            logger.log(Logger::DEBUG, "Get " + text);
+            return text;
         }
 
         ~ClientSocket() {
@@ -0,0 +1,162 @@
+#ifndef PLAYERCHANNEL_H
+#define PLAYERCHANNEL_H
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Waiting players sent between the server processes of a cluster: every process has a unix datagram socket in the
+// abstract namespace named after the cluster and its pid, a player is one datagram with its socket in SCM_RIGHTS
+//   u64 queued at (steady clock ns), u32 unread size, u32 unsent size, u8 login size, u8 binary,
+//   the login, the received bytes not handled yet, the answers the socket didn't take yet.
+class playerChannel {
+public:
+    struct parcel {
+        int fd = -1; // -1 - a broken datagram, nothing to adopt
+        std::string login;
+        std::string unread;
+        std::string unsent;
+        int64_t queuedAt = 0;
+        bool binary = false;
+    };
+
+private:
+    static const size_t HEADERSIZE = 18;
+    static const size_t MAXSIZE = 192 * 1024; // a bigger parcel stays in its process
+
+    std::string name;
+    int fd = -1;
+    std::vector<char> buffer;
+
+    [[nodiscard]] sockaddr_un address(uint32_t pid, socklen_t &length) const {
+        sockaddr_un to{};
+        to.sun_family = AF_UNIX;
+        const std::string path = "tictactoe-" + name + "-" + std::to_string(pid);
+        memcpy(to.sun_path + 1, path.data(), std::min(path.size(), sizeof(to.sun_path) - 1)); // sun_path[0] = 0
+        length = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + path.size());
+        return to;
+    }
+
+public:
+    playerChannel(std::string name, uint32_t pid) : name(std::move(name)), buffer(MAXSIZE) {
+        fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        socklen_t length;
+        const sockaddr_un own = address(pid, length);
+        if (fd < 0 || bind(fd, reinterpret_cast<const sockaddr *>(&own), length) < 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw std::invalid_argument("Can't open the cluster channel");
+        }
+        int bytes = MAXSIZE; // the kernel caps it with wmem_max
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &bytes, sizeof(bytes));
+    }
+
+    playerChannel(const playerChannel &) = delete;
+
+    playerChannel &operator=(const playerChannel &) = delete;
+
+    ~playerChannel() {
+        close(fd); // sockets of the datagrams not read yet are closed by the kernel
+    }
+
+    [[nodiscard]] int descriptor() const { // for epoll, readable when players came
+        return fd;
+    }
+
+    // false when the process is gone, its queue is full or the parcel is too big
+    bool send(uint32_t pid, const parcel &player) const {
+        const size_t size = HEADERSIZE + player.login.size() + player.unread.size() + player.unsent.size();
+        if (size > MAXSIZE || player.login.size() > UINT8_MAX) {
+            return false;
+        }
+        std::string data(HEADERSIZE, '\0');
+        const auto unreadSize = static_cast<uint32_t>(player.unread.size());
+        const auto unsentSize = static_cast<uint32_t>(player.unsent.size());
+        memcpy(data.data(), &player.queuedAt, 8);
+        memcpy(data.data() + 8, &unreadSize, 4);
+        memcpy(data.data() + 12, &unsentSize, 4);
+        data[16] = static_cast<char>(player.login.size());
+        data[17] = player.binary;
+        data.append(player.login).append(player.unread).append(player.unsent);
+
+        socklen_t length;
+        sockaddr_un to = address(pid, length);
+        iovec part{data.data(), data.size()};
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))]{};
+        msghdr message{};
+        message.msg_name = &to;
+        message.msg_namelen = length;
+        message.msg_iov = &part;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        cmsghdr *rights = CMSG_FIRSTHDR(&message);
+        rights->cmsg_level = SOL_SOCKET;
+        rights->cmsg_type = SCM_RIGHTS;
+        rights->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(rights), &player.fd, sizeof(int));
+        ssize_t result;
+        do {
+            result = sendmsg(fd, &message, MSG_DONTWAIT | MSG_NOSIGNAL);
+        } while (result < 0 && errno == EINTR);
+        return result == static_cast<ssize_t>(data.size());
+    }
+
+    // false when there is nothing to read
+    bool receive(parcel &player) {
+        iovec part{buffer.data(), buffer.size()};
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))]{};
+        msghdr message{};
+        message.msg_iov = &part;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        ssize_t size;
+        do {
+            size = recvmsg(fd, &message, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+        } while (size < 0 && errno == EINTR);
+        if (size < 0) {
+            return false;
+        }
+        player = {};
+        for (cmsghdr *rights = CMSG_FIRSTHDR(&message); rights; rights = CMSG_NXTHDR(&message, rights)) {
+            if (rights->cmsg_level == SOL_SOCKET && rights->cmsg_type == SCM_RIGHTS) {
+                memcpy(&player.fd, CMSG_DATA(rights), sizeof(int));
+            }
+        }
+        uint32_t unreadSize = 0, unsentSize = 0;
+        if (size >= static_cast<ssize_t>(HEADERSIZE)) {
+            memcpy(&player.queuedAt, buffer.data(), 8);
+            memcpy(&unreadSize, buffer.data() + 8, 4);
+            memcpy(&unsentSize, buffer.data() + 12, 4);
+        }
+        const size_t loginSize = size >= static_cast<ssize_t>(HEADERSIZE) ? static_cast<uint8_t>(buffer[16]) : 0;
+        if (size < static_cast<ssize_t>(HEADERSIZE) || (message.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) ||
+            HEADERSIZE + loginSize + unreadSize + unsentSize != static_cast<size_t>(size)) {
+            if (player.fd >= 0) {
+                close(player.fd);
+            }
+            player.fd = -1;
+            return true;
+        }
+        player.binary = buffer[17] != 0;
+        std::string_view rest(buffer.data() + HEADERSIZE, size - HEADERSIZE);
+        player.login = rest.substr(0, loginSize);
+        player.unread = rest.substr(loginSize, unreadSize);
+        player.unsent = rest.substr(loginSize + unreadSize, unsentSize);
+        return true;
+    }
+};
+
+#endif
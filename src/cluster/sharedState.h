@@ -0,0 +1,389 @@
+#ifndef SHAREDSTATE_H
+#define SHAREDSTATE_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// What the server processes of one host share, in a POSIX shared memory object: the table of processes,
+// a ring of tickets of the processes with a lonely waiting player, an open-addressing table of users
+// and a ring of the users published or rated lately, so a process saves them without reading the whole table.
+// Everything is changed with atomics only, so a process never waits for a crashed one; it waits for a live one
+// only while that one writes a new user, a few stores.
+// The first process to attach (re)creates the object, the ones attaching later see the same memory.
+class sharedState {
+public:
+    static const size_t MAXPROCESSES = 64;
+    static const size_t CHANGES = 1 << 16; // the ring of changed users
+    static const size_t LOGINSIZE = 32;
+    static const size_t PASSWORDSIZE = 32;
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+private:
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "atomics in shared memory must not use locks");
+
+    // the slot is claimed by a CAS of hash to CLAIMED | pid, the login and the password are written before the hash
+    struct user {
+        std::atomic<uint64_t> hash; // 0 - free slot
+        std::atomic<uint32_t> owner; // pid of the process where the user is logged in, 0 - nobody
+        std::atomic<int32_t> rating; // 0 - not known yet
+        uint8_t loginSize;
+        uint8_t passwordSize;
+        char login[LOGINSIZE];
+        char password[PASSWORDSIZE];
+    };
+
+    struct process {
+        std::atomic<uint32_t> pid; // 0 - free slot
+        std::atomic<bool> isAnnounced; // its ticket is in the ring
+    };
+
+    struct ticket { // cell of a bounded MPMC ring, the sequence tells whose turn it is
+        std::atomic<uint64_t> sequence;
+        std::atomic<uint32_t> process;
+    };
+
+    struct header {
+        char magic[8];
+        uint64_t capacity; // user slots, power of two
+        std::atomic<uint64_t> count; // used user slots
+        std::atomic<uint64_t> head; // the next ticket to take
+        std::atomic<uint64_t> tail; // the next ticket to put
+        process processes[MAXPROCESSES];
+        ticket tickets[MAXPROCESSES]; // a process has one ticket at most, so the ring never overflows
+        std::atomic<uint64_t> changed; // changes put into the ring so far
+        std::atomic<uint64_t> changes[CHANGES]; // the low 32 bits of position + 1, then the user slot
+    };
+
+    static constexpr char MAGIC[8] = "TTTSHM1";
+    static constexpr uint64_t CLAIMED = uint64_t{1} << 63; // in the hash of a slot being written, never in a real one
+
+    int fd = -1;
+    void *mapping = MAP_FAILED;
+    size_t size = 0;
+    header *head = nullptr;
+    user *users = nullptr;
+    uint32_t self = 0; // pid of this process
+    size_t slot = 0; // in the table of processes
+
+    static uint64_t hash(std::string_view login) { // FNV-1a, never 0 or CLAIMED
+        uint64_t value = 14695981039346656037ull;
+        for (char c: login) {
+            value = (value ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+        }
+        value &= ~CLAIMED;
+        return value ? value : 1;
+    }
+
+    bool lock(off_t byte, short type, bool wait) const { // open file description locks die with the process
+        struct flock range{};
+        range.l_type = type;
+        range.l_whence = SEEK_SET;
+        range.l_start = byte;
+        range.l_len = 1;
+        while (fcntl(fd, wait ? F_OFD_SETLKW : F_OFD_SETLK, &range) < 0) {
+            if (errno != EINTR) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void noteChange(uint32_t user) { // the user was published or got a new rating
+        const uint64_t position = head->changed.fetch_add(1);
+        head->changes[position & (CHANGES - 1)].store((position + 1) << 32 | user, std::memory_order_release);
+    }
+
+    static std::string_view loginOf(const user &entry) {
+        return {entry.login, entry.loginSize};
+    }
+
+    void attach() { // takes a free slot or the one of a dead process
+        for (size_t i = 0; i < MAXPROCESSES; ++i) {
+            uint32_t pid = head->processes[i].pid.load();
+            if ((pid == 0 || !isAlive(pid)) && head->processes[i].pid.compare_exchange_strong(pid, self)) {
+                slot = i;
+                return;
+            }
+        }
+        throw std::invalid_argument("Too many server processes in the cluster");
+    }
+
+    bool push(uint32_t process) { // Vyukov's bounded queue
+        uint64_t position = head->tail.load(std::memory_order_relaxed);
+        while (true) {
+            ticket &cell = head->tickets[position & (MAXPROCESSES - 1)];
+            const int64_t difference = static_cast<int64_t>(cell.sequence.load(std::memory_order_acquire) - position);
+            if (difference == 0) {
+                if (head->tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.process.store(process, std::memory_order_relaxed);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = head->tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool pop(uint32_t &process) {
+        uint64_t position = head->head.load(std::memory_order_relaxed);
+        while (true) {
+            ticket &cell = head->tickets[position & (MAXPROCESSES - 1)];
+            const int64_t difference =
+                    static_cast<int64_t>(cell.sequence.load(std::memory_order_acquire) - (position + 1));
+            if (difference == 0) {
+                if (head->head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    process = cell.process.load(std::memory_order_relaxed);
+                    cell.sequence.store(position + MAXPROCESSES, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = head->head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // the written hash of the slot; a live process writing it is waited for, the slot of a crashed one is freed,
+    // the probe sequences through it are the ones of before the claim
+    uint64_t settle(user &entry) {
+        uint64_t current = entry.hash.load(std::memory_order_acquire);
+        while (current & CLAIMED) {
+            if (isAlive(static_cast<uint32_t>(current))) {
+                std::this_thread::yield();
+                current = entry.hash.load(std::memory_order_acquire);
+            } else if (entry.hash.compare_exchange_strong(current, 0, std::memory_order_acq_rel)) {
+                head->count.fetch_sub(1);
+                return 0;
+            }
+        }
+        return current;
+    }
+
+    // the slot of the login, the new one is filled with the password; NONE when it isn't there or the table is full
+    uint32_t probe(std::string_view login, std::string_view password, bool isInserting, bool &isNew) {
+        isNew = false;
+        const uint64_t value = hash(login);
+        const size_t mask = head->capacity - 1;
+        for (size_t i = value & mask, probes = 0; probes <= mask; i = (i + 1) & mask, ++probes) {
+            user &entry = users[i];
+            uint64_t current;
+            while ((current = settle(entry)) == 0) {
+                if (!isInserting) {
+                    return NONE;
+                }
+                if (head->count.fetch_add(1) * 2 >= head->capacity) { // keep the probe sequences short
+                    head->count.fetch_sub(1);
+                    return NONE;
+                }
+                if (entry.hash.compare_exchange_strong(current, CLAIMED | self, std::memory_order_acq_rel)) {
+                    entry.loginSize = static_cast<uint8_t>(login.size());
+                    entry.passwordSize = static_cast<uint8_t>(password.size());
+                    memcpy(entry.login, login.data(), login.size());
+                    memcpy(entry.password, password.data(), password.size());
+                    entry.hash.store(value, std::memory_order_release);
+                    noteChange(static_cast<uint32_t>(i));
+                    isNew = true;
+                    return static_cast<uint32_t>(i);
+                }
+                head->count.fetch_sub(1); // another process took the slot
+            }
+            if (current == value && loginOf(entry) == login) {
+                return static_cast<uint32_t>(i);
+            }
+        }
+        return NONE;
+    }
+
+public:
+    static bool isAlive(uint32_t pid) {
+        return pid != 0 && (kill(static_cast<pid_t>(pid), 0) == 0 || errno != ESRCH);
+    }
+
+    sharedState(const std::string &name, size_t capacity) : self(static_cast<uint32_t>(getpid())) {
+        if (!std::has_single_bit(capacity)) {
+            throw std::invalid_argument("Cluster users must be a power of two");
+        }
+        fd = shm_open(("/" + name).c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            throw std::invalid_argument("Can't open shared memory: " + name);
+        }
+        size = sizeof(header) + capacity * sizeof(user);
+        lock(0, F_WRLCK, true); // byte 0 - processes attach one by one
+        const bool isFirst = lock(1, F_WRLCK, false); // byte 1 - read-locked by every attached process
+        struct stat info{};
+        if ((isFirst && (ftruncate(fd, 0) < 0 || ftruncate(fd, static_cast<off_t>(size)) < 0)) || // zeroed
+            fstat(fd, &info) < 0 || static_cast<size_t>(info.st_size) != size) {
+            close(fd);
+            throw std::invalid_argument("Shared memory " + name + " has another size, check ClusterUsers");
+        }
+        mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            throw std::invalid_argument("Can't map shared memory: " + name);
+        }
+        head = static_cast<header *>(mapping);
+        users = reinterpret_cast<user *>(static_cast<char *>(mapping) + sizeof(header));
+        if (isFirst) {
+            memcpy(head->magic, MAGIC, sizeof(MAGIC));
+            head->capacity = capacity;
+            for (size_t i = 0; i < MAXPROCESSES; ++i) {
+                head->tickets[i].sequence.store(i);
+            }
+        }
+        lock(1, F_RDLCK, true);
+        lock(0, F_UNLCK, true);
+        attach();
+    }
+
+    sharedState(const sharedState &) = delete;
+
+    sharedState &operator=(const sharedState &) = delete;
+
+    ~sharedState() { // users of this process can log in elsewhere at once
+        for (size_t i = 0; i < head->capacity; ++i) {
+            uint32_t owner = self;
+            users[i].owner.compare_exchange_strong(owner, 0);
+        }
+        head->processes[slot].pid.store(0);
+        munmap(mapping, size);
+        close(fd); // the locks go with it
+    }
+
+    [[nodiscard]] uint32_t pid() const {
+        return self;
+    }
+
+    // the slot of the user, published by the process that has it first; isNew - nobody had the login
+    uint32_t publish(std::string_view login, std::string_view password, bool &isNew) {
+        if (login.size() > LOGINSIZE || password.size() > PASSWORDSIZE) {
+            isNew = false;
+            return NONE;
+        }
+        return probe(login, password, true, isNew);
+    }
+
+    [[nodiscard]] uint32_t find(std::string_view login) {
+        bool isNew;
+        return probe(login, {}, false, isNew);
+    }
+
+    [[nodiscard]] std::string_view login(uint32_t user) const {
+        return loginOf(users[user]);
+    }
+
+    [[nodiscard]] std::string_view password(uint32_t user) const {
+        return {users[user].password, users[user].passwordSize};
+    }
+
+    // the 405 check of all processes, the rating goes the way of the newer one
+    bool logIn(uint32_t user, int &rating) {
+        uint32_t owner = users[user].owner.load();
+        do {
+            if (owner != 0 && isAlive(owner)) {
+                return false;
+            }
+        } while (!users[user].owner.compare_exchange_weak(owner, self));
+        int32_t known = 0;
+        if (!users[user].rating.compare_exchange_strong(known, rating)) {
+            rating = known;
+        } else {
+            noteChange(user);
+        }
+        return true;
+    }
+
+    void logOut(uint32_t user) { // nothing when the user went to another process
+        uint32_t owner = self;
+        users[user].owner.compare_exchange_strong(owner, 0);
+    }
+
+    bool moveOwner(uint32_t user, uint32_t from, uint32_t to) {
+        return users[user].owner.compare_exchange_strong(from, to);
+    }
+
+    [[nodiscard]] int rating(uint32_t user) const {
+        return users[user].rating.load(std::memory_order_relaxed);
+    }
+
+    void setRating(uint32_t user, int rating) {
+        users[user].rating.store(rating, std::memory_order_relaxed);
+        noteChange(user);
+    }
+
+    template<typename F>
+    void forEach(F &&function) const { // function(slot) for every published user
+        for (size_t i = 0; i < head->capacity; ++i) {
+            const uint64_t current = users[i].hash.load(std::memory_order_acquire);
+            if (current != 0 && !(current & CLAIMED)) { // a slot being written is noted by its writer later
+                function(static_cast<uint32_t>(i));
+            }
+        }
+    }
+
+    [[nodiscard]] uint64_t changeCount() const {
+        return head->changed.load();
+    }
+
+    // function(slot) for the users changed since cursor, which is moved past them; false when some of them
+    // were overwritten before they were read, then the caller goes through every user with forEach()
+    template<typename F>
+    bool forEachChange(uint64_t &cursor, F &&function) const {
+        const uint64_t end = head->changed.load();
+        if (end - cursor > CHANGES) {
+            cursor = end;
+            return false;
+        }
+        for (; cursor < end; ++cursor) {
+            const uint64_t value = head->changes[cursor & (CHANGES - 1)].load(std::memory_order_acquire);
+            const auto lap = static_cast<int32_t>(static_cast<uint32_t>(value >> 32) -
+                                                  static_cast<uint32_t>(cursor + 1));
+            if (lap < 0) { // still being written, read by the next call
+                break;
+            }
+            if (lap > 0) {
+                cursor = end;
+                return false;
+            }
+            function(static_cast<uint32_t>(value));
+        }
+        return true;
+    }
+
+    // this process has a lonely waiting player, the first other one with a lonely player sends its player here
+    void announce() {
+        bool isAnnounced = false;
+        if (head->processes[slot].isAnnounced.compare_exchange_strong(isAnnounced, true) && !push(slot)) {
+            head->processes[slot].isAnnounced.store(false);
+        }
+    }
+
+    // pid of a live process that announced a lonely player, 0 - none; the ticket of this one is dropped
+    uint32_t takeTicket() {
+        for (uint32_t process; pop(process);) {
+            head->processes[process].isAnnounced.store(false);
+            const uint32_t pid = head->processes[process].pid.load();
+            if (pid != self && isAlive(pid)) {
+                return pid;
+            }
+        }
+        return 0;
+    }
+};
+
+#endif
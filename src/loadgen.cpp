@@ -0,0 +1,490 @@
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <queue>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <iomanip>
+
+#include "frame.h"
+#include "binary.h"
+#include "histogram.h"
+
+// Load generator: opens many connections to the server, registers and logs in every one,
+// then plays games until the time is over and prints latency percentiles.
+// One thread with epoll is enough, the clients only wait for the server.
+namespace TicTacToeLoad {
+
+    using clock = std::chrono::steady_clock;
+
+    class loadGenerator {
+    private:
+        enum clientState {
+            IDLE, // not connected yet
+            CONNECTING,
+            REGISTERING,
+            LOGGING,
+            WAITING, // in the queue
+            PLAYING,
+            DONE
+        };
+
+        struct client {
+            int fd = -1;
+            clientState state = IDLE;
+            protocol::frameBuffer inbox;
+            std::string outbox; // bytes the socket did not take yet
+            clock::time_point connectAt;
+            clock::time_point queuedAt;
+            clock::time_point putAt;
+            std::vector<bool> taken; // cells of the current game
+            size_t lastPut = SIZE_MAX; // cell sent and not confirmed yet
+            bool myTurn = false;
+            size_t timer = 0; // generation of the scheduled move, older timers are ignored
+            size_t games = 0;
+        };
+
+        struct timer {
+            clock::time_point at;
+            size_t idx;
+            size_t generation;
+
+            bool operator>(const timer &other) const {
+                return at > other.at;
+            }
+        };
+
+        std::unordered_map<std::string, std::string> configData; // container for config data
+
+        // settings
+        sockaddr_in address{};
+        size_t clientCount = 100;
+        double connectRate = 1000; // new connections per second
+        std::chrono::milliseconds think{10}; // pause before every move
+        std::chrono::seconds duration{10};
+        size_t gamesPerClient = 0; // 0 - play until the time is over
+        bool binary = false;
+        bool randomMoves = true; // otherwise the first free cell, the same game every time
+        std::string prefix = "load";
+
+        static constexpr std::chrono::seconds DRAINTIME{5}; // games started before the deadline may end so long
+
+        std::vector<client> clients;
+        int epoll_fd = -1;
+        std::priority_queue<timer, std::vector<timer>, std::greater<>> timers;
+        std::mt19937_64 rng;
+
+        // results
+        histogram connectLatency; // microseconds
+        histogram matchLatency; // login or "again" to restart
+        histogram moveLatency; // put to the move echo
+        size_t connected = 0;
+        size_t loggedIn = 0;
+        size_t errors = 0;
+        size_t unfinished = 0; // players still in a game when the drain time was over
+        size_t gamesEnded = 0; // counted by every player, so a match of two clients is counted twice
+        clock::time_point started;
+        clock::time_point firstMatch = clock::time_point::max();
+
+        void readCfg(int argc, char **argv) {
+            std::ifstream cfgFile("loadgen.config");
+            std::vector<std::string> lines;
+            for (std::string currentLine{}; std::getline(cfgFile, currentLine);) {
+                lines.push_back(currentLine);
+            }
+            for (int i = 1; i < argc; ++i) { // "Key=value" arguments override the file
+                lines.emplace_back(argv[i]);
+            }
+            for (const std::string &currentLine: lines) {
+                if (currentLine.find('=') != std::string::npos) {
+                    std::istringstream iss{currentLine};
+                    if (std::string id{}, value{}; std::getline(std::getline(iss, id, '='), value)) {
+                        std::transform(id.begin(), id.end(), id.begin(), [](unsigned char c) { return toupper(c); });
+                        configData[id] = value;
+                    }
+                }
+            }
+
+            address = {AF_INET, htons(std::stoul(configData.contains("PORT") ? configData["PORT"] : "5500")),
+                       {inet_addr(configData.contains("HOST") ? configData["HOST"].c_str() : "127.0.0.1")}, {}};
+            if (configData.contains("CLIENTS")) {
+                clientCount = std::stoul(configData["CLIENTS"]);
+            }
+            if (configData.contains("CONNECTRATE")) {
+                connectRate = std::max(1.0, std::stod(configData["CONNECTRATE"]));
+            }
+            if (configData.contains("THINK")) {
+                think = std::chrono::milliseconds(std::stoul(configData["THINK"]));
+            }
+            if (configData.contains("DURATION")) {
+                duration = std::chrono::seconds(std::stoul(configData["DURATION"]));
+            }
+            if (configData.contains("GAMES")) {
+                gamesPerClient = std::stoul(configData["GAMES"]);
+            }
+            if (configData.contains("PREFIX")) {
+                prefix = configData["PREFIX"];
+            }
+            binary = configData["PROTOCOL"] == "binary";
+            randomMoves = configData["MOVES"] != "first";
+            rng.seed(configData.contains("SEED") ? std::stoull(configData["SEED"])
+                                                 : clock::now().time_since_epoch().count());
+        }
+
+        static uint64_t micros(clock::duration time) {
+            return std::chrono::duration_cast<std::chrono::microseconds>(time).count();
+        }
+
+        void fail(const size_t idx, const std::string &reason) {
+            ++errors;
+            std::cerr << "Client " << idx << ": " << reason << '\n';
+            finish(idx);
+        }
+
+        void finish(const size_t idx) {
+            client &c = clients[idx];
+            if (c.fd >= 0) {
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c.fd, nullptr);
+                close(c.fd);
+                c.fd = -1;
+            }
+            c.state = DONE;
+        }
+
+        void watch(const size_t idx, const bool writable) {
+            epoll_event event{};
+            event.events = writable ? EPOLLIN | EPOLLOUT : EPOLLIN;
+            event.data.u64 = idx;
+            epoll_ctl(epoll_fd, EPOLL_CTL_MOD, clients[idx].fd, &event);
+        }
+
+        void openConnection(const size_t idx) {
+            client &c = clients[idx];
+            c.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (c.fd < 0) {
+                fail(idx, "Socket creation error");
+                return;
+            }
+            int one = 1;
+            setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            c.connectAt = clock::now();
+            c.state = CONNECTING;
+            epoll_event event{};
+            event.events = EPOLLOUT;
+            event.data.u64 = idx;
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, c.fd, &event);
+            if (connect(c.fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 && errno != EINPROGRESS) {
+                fail(idx, "Connection Failed");
+            }
+        }
+
+        void sendMessage(const size_t idx, const std::string &message) {
+            client &c = clients[idx];
+            std::string request;
+            const bool pending = !c.outbox.empty();
+            protocol::appendFrame(c.outbox, binary && protocol::requestToBinary(message, request) ? request : message);
+            if (!pending) {
+                flush(idx);
+            }
+        }
+
+        void flush(const size_t idx) {
+            client &c = clients[idx];
+            while (!c.outbox.empty()) {
+                ssize_t sent = send(c.fd, c.outbox.data(), c.outbox.size(), MSG_NOSIGNAL);
+                if (sent < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    watch(idx, true); // the rest goes when the socket is writable
+                    return;
+                }
+                if (sent < 0) {
+                    fail(idx, "Connection lost");
+                    return;
+                }
+                c.outbox.erase(0, sent);
+            }
+            watch(idx, false);
+        }
+
+        void onWritable(const size_t idx) {
+            client &c = clients[idx];
+            if (c.state != CONNECTING) {
+                flush(idx);
+                return;
+            }
+            int error = 0;
+            socklen_t size = sizeof(error);
+            if (getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &error, &size) < 0 || error != 0) {
+                fail(idx, std::string("Connection Failed: ") + strerror(error));
+                return;
+            }
+            connectLatency.record(micros(clock::now() - c.connectAt));
+            ++connected;
+            c.state = REGISTERING;
+            sendMessage(idx, "reg " + prefix + std::to_string(idx) + " pass");
+        }
+
+        void onReadable(const size_t idx) {
+            client &c = clients[idx];
+            while (c.state != DONE) {
+                ssize_t valread = read(c.fd, c.inbox.writePtr(), c.inbox.writeSize());
+                if (valread < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (valread < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    return;
+                }
+                if (valread <= 0) {
+                    fail(idx, "Connection lost");
+                    return;
+                }
+                c.inbox.commit(valread);
+                std::string_view message;
+                std::string text;
+                while (c.state != DONE && c.inbox.next(message)) {
+                    text = message;
+                    if (protocol::isBinary(message) && !protocol::messageToText(message, text)) {
+                        fail(idx, "Broken binary message");
+                        return;
+                    }
+                    handleMessage(idx, text);
+                }
+                if (c.inbox.isBroken()) {
+                    fail(idx, "Broken frame");
+                    return;
+                }
+            }
+        }
+
+        void handleMessage(const size_t idx, const std::string &message) {
+            client &c = clients[idx];
+            const auto now = clock::now();
+            if (message == "shutdown") {
+                finish(idx);
+            } else if (c.state == REGISTERING) {
+                if (message != "200" && message != "400") { // taken login is fine, it is ours from the last run
+                    fail(idx, "Registration answer " + message);
+                    return;
+                }
+                c.state = LOGGING;
+                sendMessage(idx, "log " + prefix + std::to_string(idx) + " pass");
+                c.queuedAt = clock::now();
+            } else if (c.state == LOGGING) {
+                if (message != "200") {
+                    fail(idx, "Login answer " + message);
+                    return;
+                }
+                ++loggedIn;
+                c.state = WAITING;
+            } else if (message.starts_with("restart")) {
+                matchLatency.record(micros(now - c.queuedAt));
+                firstMatch = std::min(firstMatch, now);
+                size_t size = 3;
+                std::istringstream(message.substr(7)) >> size;
+                c.taken.assign(size * size, false);
+                c.state = PLAYING;
+                c.myTurn = true;
+                c.lastPut = SIZE_MAX;
+                // the server sends "lock" right after "restart", so the first move waits for it at least a think
+                schedule(idx, now + std::max(think, std::chrono::milliseconds(1)));
+            } else if (message == "timeout") { // nobody was found in the queue limit
+                c.queuedAt = now;
+                sendMessage(idx, "again");
+            } else if (c.state != PLAYING) {
+                return;
+            } else if (message == "lock") {
+                c.myTurn = false;
+                ++c.timer; // cancel the first move
+            } else if ((message[0] == 'X' || message[0] == 'O') && message.size() > 1) {
+                const size_t cell = std::stoul(message.substr(1));
+                if (cell < c.taken.size()) {
+                    c.taken[cell] = true;
+                }
+                if (cell == c.lastPut) { // our move came back
+                    moveLatency.record(micros(now - c.putAt));
+                    c.lastPut = SIZE_MAX;
+                    c.myTurn = false;
+                } else {
+                    c.myTurn = true;
+                    schedule(idx, now + think);
+                }
+            } else if (message == "win" || message == "draw" || message == "disconnect") {
+                ++gamesEnded;
+                ++c.timer;
+                if (++c.games == gamesPerClient || now - started >= duration) {
+                    finish(idx);
+                    return;
+                }
+                c.state = WAITING;
+                c.queuedAt = now;
+                sendMessage(idx, "again");
+            }
+        }
+
+        void schedule(const size_t idx, const clock::time_point at) {
+            timers.push({at, idx, ++clients[idx].timer});
+        }
+
+        void makeMove(const size_t idx) {
+            client &c = clients[idx];
+            std::vector<size_t> free;
+            for (size_t cell = 0; cell < c.taken.size(); ++cell) {
+                if (!c.taken[cell]) {
+                    free.push_back(cell);
+                }
+            }
+            if (free.empty()) {
+                return;
+            }
+            c.lastPut = randomMoves ? free[rng() % free.size()] : free.front();
+            c.putAt = clock::now();
+            sendMessage(idx, "put " + std::to_string(c.lastPut));
+        }
+
+        void runTimers(const clock::time_point now) {
+            while (!timers.empty() && timers.top().at <= now) {
+                const timer next = timers.top();
+                timers.pop();
+                client &c = clients[next.idx];
+                if (c.state == PLAYING && c.timer == next.generation && c.myTurn) {
+                    makeMove(next.idx);
+                }
+            }
+        }
+
+        void report() const {
+            const double seconds = std::chrono::duration<double>(clock::now() - started).count();
+            const double playing = firstMatch == clock::time_point::max()
+                                   ? 0 : std::chrono::duration<double>(clock::now() - firstMatch).count();
+            std::cout << std::fixed << std::setprecision(3);
+            std::cout << "clients " << clients.size() << ", connected " << connected << ", logged in " << loggedIn
+                      << ", errors " << errors << ", unfinished " << unfinished << ", " << seconds << " s\n";
+            auto line = [](const char *name, const histogram &h) {
+                std::cout << std::left << std::setw(14) << name << std::right << " n=" << std::setw(8) << h.count()
+                          << "  p50 " << std::setw(9) << h.percentile(0.5) / 1000.0 << " ms"
+                          << "  p99 " << std::setw(9) << h.percentile(0.99) / 1000.0 << " ms"
+                          << "  p999 " << std::setw(9) << h.percentile(0.999) / 1000.0 << " ms"
+                          << "  max " << std::setw(9) << h.max() / 1000.0 << " ms\n";
+            };
+            line("connect", connectLatency);
+            line("login->match", matchLatency);
+            line("move rtt", moveLatency);
+            const double matches = gamesEnded / 2.0; // both players count the game
+            std::cout << "matches " << matches << ", " << (playing > 0 ? matches / playing : 0) << "/s\n";
+        }
+
+    public:
+        loadGenerator(int argc, char **argv) try {
+            readCfg(argc, argv);
+
+            rlimit limit{};
+            if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) { // thousands of sockets
+                limit.rlim_cur = limit.rlim_max;
+                setrlimit(RLIMIT_NOFILE, &limit);
+            }
+            epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+            if (epoll_fd < 0) {
+                throw std::invalid_argument("Epoll creation error");
+            }
+            clients.resize(clientCount);
+            std::cout << "Load: " << clientCount << " clients, " << connectRate << " connections/s, think "
+                      << think.count() << " ms, " << duration.count() << " s" << std::endl;
+
+            run();
+            report();
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << '\n';
+        }
+
+        ~loadGenerator() {
+            for (size_t i = 0; i < clients.size(); ++i) {
+                finish(i);
+            }
+            if (epoll_fd >= 0) {
+                close(epoll_fd);
+            }
+        }
+
+        void run() {
+            const size_t MAXEVENTS = 256;
+            std::vector<epoll_event> events(MAXEVENTS);
+            started = clock::now();
+            const auto deadline = started + duration;
+            const auto connectStep = std::chrono::duration_cast<clock::duration>(
+                    std::chrono::duration<double>(1.0 / connectRate));
+            size_t opened = 0;
+            auto connectAt = [&](size_t idx) { // connections are spread evenly over time
+                return started + connectStep * static_cast<clock::rep>(idx);
+            };
+
+            while (true) {
+                auto now = clock::now();
+                for (; opened < clients.size() && connectAt(opened) <= now; ++opened) {
+                    openConnection(opened);
+                }
+                runTimers(now);
+                // games in progress are finished after the deadline, only new ones are not started
+                if (now >= deadline && std::none_of(clients.begin(), clients.end(), [](const client &c) {
+                    return c.state == PLAYING;
+                })) {
+                    return;
+                }
+                if (now >= deadline + DRAINTIME) { // a game is stuck, the server lost a message
+                    unfinished = std::count_if(clients.begin(), clients.end(), [](const client &c) {
+                        return c.state == PLAYING;
+                    });
+                    return;
+                }
+                if (opened == clients.size() && std::all_of(clients.begin(), clients.end(), [](const client &c) {
+                    return c.state == DONE;
+                })) {
+                    return;
+                }
+
+                auto wakeAt = now >= deadline ? std::min(now + std::chrono::milliseconds(100), deadline + DRAINTIME) : deadline;
+                if (opened < clients.size()) {
+                    wakeAt = std::min(wakeAt, connectAt(opened));
+                }
+                if (!timers.empty()) {
+                    wakeAt = std::min(wakeAt, timers.top().at);
+                }
+                const auto timeout = std::chrono::ceil<std::chrono::milliseconds>(wakeAt - now).count();
+                int activity = epoll_wait(epoll_fd, events.data(), MAXEVENTS, static_cast<int>(std::max<long>(0, timeout)));
+                if (activity < 0 && errno != EINTR) {
+                    throw std::invalid_argument("Epoll error");
+                }
+                for (int e = 0; e < activity; ++e) {
+                    const auto idx = static_cast<size_t>(events[e].data.u64);
+                    if (clients[idx].state == DONE) {
+                        continue;
+                    }
+                    if (events[e].events & (EPOLLOUT | EPOLLERR)) {
+                        onWritable(idx);
+                    }
+                    if (clients[idx].state != DONE && events[e].events & (EPOLLIN | EPOLLHUP)) {
+                        onReadable(idx);
+                    }
+                }
+            }
+        }
+    };
+}
+
+int main(int argc, char **argv) {
+    TicTacToeLoad::loadGenerator load(argc, argv);
+    return 0;
+}
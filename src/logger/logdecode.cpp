@@ -0,0 +1,88 @@
+#include "logger.h"
+
+#include <unordered_map>
+#include <vector>
+
+// Renders a binary log of Logger::setBinary() as the text log: logdecode <binary log> [text log]
+namespace {
+    uint64_t getInt(const std::string &data, size_t pos, size_t bytes) { // little-endian
+        uint64_t value = 0;
+        for (size_t i = 0; i < bytes; ++i) {
+            value |= static_cast<uint64_t>(static_cast<uint8_t>(data[pos + i])) << (8 * i);
+        }
+        return value;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argc > 3) {
+        std::cerr << "Usage: " << argv[0] << " <binary log> [text log]\n";
+        return 1;
+    }
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in.is_open()) {
+        std::cerr << "Can't open " << argv[1] << '\n';
+        return 1;
+    }
+    const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (!data.starts_with(Logger::MAGIC)) {
+        std::cerr << argv[1] << " is not a binary log\n";
+        return 1;
+    }
+    std::ofstream file;
+    if (argc == 3) {
+        file.open(argv[2]);
+        if (!file.is_open()) {
+            std::cerr << "Can't open " << argv[2] << '\n';
+            return 1;
+        }
+    }
+    std::ostream &out = argc == 3 ? file : std::cout;
+
+    std::unordered_map<uint16_t, std::string> formats;
+    std::string line;
+    std::time_t lastSecond = -1;
+    std::string lastStamp;
+    size_t pos = Logger::MAGIC.size();
+    while (pos < data.size()) {
+        const char kind = data[pos];
+        if (kind == 'F' && pos + 5 <= data.size()) {
+            const auto id = static_cast<uint16_t>(getInt(data, pos + 1, 2));
+            const size_t size = getInt(data, pos + 3, 2);
+            if (pos + 5 + size > data.size()) {
+                break;
+            }
+            formats[id] = data.substr(pos + 5, size);
+            pos += 5 + size;
+        } else if (kind == 'R' && pos + 14 <= data.size()) {
+            const auto format = static_cast<uint16_t>(getInt(data, pos + 1, 2));
+            const auto type = static_cast<Logger::logType>(getInt(data, pos + 3, 1));
+            const auto nanos = static_cast<int64_t>(getInt(data, pos + 4, 8));
+            const size_t size = getInt(data, pos + 12, 2);
+            if (pos + 14 + size > data.size() || type > Logger::ERROR) {
+                break;
+            }
+            const std::time_t second = nanos / 1000000000;
+            if (second != lastSecond) {
+                lastStamp = Logger::timeStamp(second);
+                lastSecond = second;
+            }
+            const auto known = formats.find(format);
+            if (format != Logger::PLAIN && known == formats.end()) {
+                std::cerr << "Unknown format " << format << " at " << pos << '\n';
+            }
+            line.clear();
+            Logger::render(line, lastStamp, type, format, known == formats.end() ? "" : known->second,
+                           data.data() + pos + 14, size);
+            out << line;
+            pos += 14 + size;
+        } else {
+            break;
+        }
+    }
+    if (pos < data.size()) {
+        std::cerr << "Broken record at " << pos << '\n';
+        return 1;
+    }
+    return 0;
+}
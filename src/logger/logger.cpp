@@ -1,22 +1,306 @@
 #include "logger.h"
 
-Logger::Logger(const std::string &filePath) try {
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+
+namespace {
+    // formats of LOGF(), filled before main() by the static ids
+    struct formatRegistry {
+        static const size_t CAPACITY = 4096;
+        std::array<const char *, CAPACITY> formats{};
+        std::atomic<size_t> count{0};
+        std::mutex mutex;
+    };
+
+    formatRegistry &registry() {
+        static formatRegistry instance;
+        return instance;
+    }
+
+    void putInt(std::string &out, uint64_t value, size_t bytes) { // little-endian
+        for (size_t i = 0; i < bytes; ++i) {
+            out += static_cast<char>(value >> (8 * i) & 0xFF);
+        }
+    }
+
+    bool getVarint(const char *args, size_t size, size_t &pos, uint64_t &value) {
+        value = 0;
+        for (int shift = 0; pos < size && shift < 64; shift += 7) {
+            const auto byte = static_cast<uint8_t>(args[pos++]);
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+Logger::Logger(const std::string &filePath, const overflowPolicy policy, size_t capacity) try:
+        policy(policy) {
+    capacity = std::bit_ceil(std::max<size_t>(capacity, 2));
+    ring = std::make_unique<record[]>(capacity);
+    mask = capacity - 1;
+    for (size_t i = 0; i < capacity; ++i) {
+        ring[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
     logFile.open(filePath);
     if (!logFile.is_open()) {
         throw std::invalid_argument("Can't open log file: " + filePath);
     }
+    writer = std::thread(&Logger::writeLoop, this);
 } catch (const std::exception &e) {
     std::cerr << e.what();
 }
 
 Logger::~Logger() {
+    stopping = true;
+    wakeWriter();
+    if (writer.joinable()) {
+        writer.join();
+    }
     logFile.close();
 }
 
-void Logger::log(const Logger::logType logType, const std::string &message) {
-    const auto currentTime = std::chrono::system_clock::now();
-    const auto t_c = std::chrono::system_clock::to_time_t(currentTime);
-    const auto gmt_time = gmtime(&t_c);
-    logFile << std::put_time(gmt_time, "%Y-%m-%d %H:%M:%S") << " - [" << logMapper[logType] << "] " << message
-            << std::endl;
+void Logger::setOverflowPolicy(const overflowPolicy newPolicy) {
+    policy = newPolicy;
+}
+
+void Logger::setLevel(const logType level) {
+    minSeverity = severity(level);
+}
+
+void Logger::setBinary(const std::string &filePath) {
+    if (binaryRequested.load(std::memory_order_acquire)) {
+        return; // the file is chosen once
+    }
+    binaryPath = filePath;
+    binaryRequested.store(true, std::memory_order_release);
+    wakeWriter();
+}
+
+uint16_t Logger::registerFormat(const char *format) {
+    formatRegistry &formats = registry();
+    std::lock_guard lock(formats.mutex);
+    const size_t id = formats.count.load(std::memory_order_relaxed);
+    if (id >= formatRegistry::CAPACITY) {
+        throw std::invalid_argument("Too many log formats");
+    }
+    formats.formats[id] = format;
+    formats.count.store(id + 1, std::memory_order_release);
+    return static_cast<uint16_t>(id);
+}
+
+std::string_view Logger::getFormat(const uint16_t id) {
+    formatRegistry &formats = registry();
+    return id < formats.count.load(std::memory_order_acquire) ? formats.formats[id] : std::string_view();
+}
+
+void Logger::render(std::string &out, const std::string_view stamp, const logType type, const uint16_t format,
+                    const std::string_view formatText, const char *args, const size_t size) {
+    out += stamp;
+    out += " - [";
+    out += logMapper[type];
+    out += "] ";
+    if (format == PLAIN) {
+        out.append(args, size);
+        out += '\n';
+        return;
+    }
+    size_t pos = 0;
+    for (size_t i = 0; i < formatText.size(); ++i) {
+        if (formatText[i] != '{' || i + 1 == formatText.size() || formatText[i + 1] != '}') {
+            out += formatText[i];
+            continue;
+        }
+        ++i;
+        if (pos >= size) { // the argument was cut
+            out += "{?}";
+            continue;
+        }
+        const char tag = args[pos++];
+        uint64_t value;
+        if (tag == 's' && pos < size) {
+            const auto stored = static_cast<uint8_t>(args[pos++]);
+            const size_t length = std::min<size_t>(stored, size - pos);
+            out.append(args + pos, length);
+            pos += length;
+        } else if (tag == 'u' && getVarint(args, size, pos, value)) {
+            out += std::to_string(value);
+        } else if (tag == 'i' && getVarint(args, size, pos, value)) {
+            out += std::to_string(static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1));
+        } else {
+            out += "{?}";
+            pos = size;
+        }
+    }
+    out += '\n';
+}
+
+std::string Logger::timeStamp(const std::time_t time) {
+    std::tm gmt{};
+    std::ostringstream stamp;
+    stamp << std::put_time(gmtime_r(&time, &gmt), "%Y-%m-%d %H:%M:%S");
+    return stamp.str();
+}
+
+Logger::record *Logger::claim(size_t &pos) {
+    pos = enqueuePos.load(std::memory_order_relaxed);
+    while (true) {
+        record *current = &ring[pos & mask];
+        size_t sequence = current->sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<ptrdiff_t>(sequence) - static_cast<ptrdiff_t>(pos);
+        if (diff == 0) { // the record is free, try to claim it
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                current->time = std::chrono::system_clock::now();
+                return current;
+            }
+        } else if (diff < 0) { // ring is full
+            if (policy.load(std::memory_order_relaxed) == DROP || !writer.joinable()) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            wakeWriter();
+            std::this_thread::yield();
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        } else { // another producer took it
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void Logger::commit(record *current, const size_t pos) {
+    current->sequence.store(pos + 1, std::memory_order_release); // ready for the writer
+
+    std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with the fence in writeLoop
+    if (sleeping.load(std::memory_order_relaxed)) {
+        wakeWriter();
+    }
+}
+
+void Logger::log(const Logger::logType logType, std::string_view message) {
+    if (!isEnabled(logType)) {
+        return;
+    }
+    size_t pos;
+    record *current = claim(pos);
+    if (!current) {
+        return;
+    }
+    current->type = logType;
+    current->format = PLAIN;
+    current->size = static_cast<uint16_t>(std::min(message.size(), TEXTSIZE));
+    memcpy(current->text, message.data(), current->size);
+    commit(current, pos);
+}
+
+bool Logger::isEmpty() const {
+    return ring[dequeuePos & mask].sequence.load(std::memory_order_acquire) != dequeuePos + 1;
+}
+
+void Logger::wakeWriter() {
+    signal.fetch_add(1, std::memory_order_release);
+    signal.notify_one();
+}
+
+void Logger::switchToBinary() {
+    std::ofstream binaryFile(binaryPath, std::ios::binary | std::ios::trunc);
+    if (!binaryFile.is_open()) {
+        std::cerr << "Can't open binary log file: " << binaryPath << '\n';
+        binaryRequested = false;
+        return;
+    }
+    logFile.flush();
+    logFile = std::move(binaryFile);
+    logFile.write(MAGIC.data(), static_cast<std::streamsize>(MAGIC.size()));
+    isBinary = true;
+    formatsWritten = 0;
+}
+
+void Logger::writeRecord(std::string &batch, const record &current, std::time_t &lastSecond,
+                         std::string &lastStamp) {
+    if (!isBinary) {
+        // the date is formatted once per second
+        const auto t_c = std::chrono::system_clock::to_time_t(current.time);
+        if (t_c != lastSecond) {
+            lastStamp = timeStamp(t_c);
+            lastSecond = t_c;
+        }
+        render(batch, lastStamp, current.type, current.format, getFormat(current.format), current.text,
+               current.size);
+        return;
+    }
+
+    if (current.format != PLAIN && current.format >= formatsWritten) { // new formats go before their records
+        for (const size_t count = registry().count.load(std::memory_order_acquire); formatsWritten < count;
+             ++formatsWritten) {
+            const std::string_view format = getFormat(formatsWritten);
+            batch += 'F';
+            putInt(batch, formatsWritten, 2);
+            putInt(batch, format.size(), 2);
+            batch += format;
+        }
+    }
+    batch += 'R';
+    putInt(batch, current.format, 2);
+    putInt(batch, current.type, 1);
+    putInt(batch, std::chrono::duration_cast<std::chrono::nanoseconds>(current.time.time_since_epoch()).count(), 8);
+    putInt(batch, current.size, 2);
+    batch.append(current.text, current.size);
+}
+
+size_t Logger::drain(std::string &batch, std::time_t &lastSecond, std::string &lastStamp) {
+    if (!isBinary && binaryRequested.load(std::memory_order_acquire)) {
+        switchToBinary();
+    }
+    size_t count = 0;
+    batch.clear();
+    while (count <= mask && !isEmpty()) { // at most one ring per write
+        record &current = ring[dequeuePos & mask];
+        writeRecord(batch, current, lastSecond, lastStamp);
+        current.sequence.store(dequeuePos + mask + 1, std::memory_order_release); // free for producers
+        ++dequeuePos;
+        ++count;
+    }
+    if (size_t lost = dropped.exchange(0, std::memory_order_relaxed); lost > 0) {
+        record warning;
+        warning.time = std::chrono::system_clock::now();
+        warning.type = WARNING;
+        warning.format = PLAIN;
+        const std::string text = std::to_string(lost) + " log messages dropped";
+        warning.size = static_cast<uint16_t>(text.size());
+        memcpy(warning.text, text.data(), text.size());
+        writeRecord(batch, warning, lastSecond, lastStamp);
+    }
+    if (!batch.empty()) {
+        logFile.write(batch.data(), static_cast<std::streamsize>(batch.size()));
+        logFile.flush();
+    }
+    return count;
+}
+
+void Logger::writeLoop() {
+    std::string batch;
+    std::time_t lastSecond = -1;
+    std::string lastStamp;
+    while (true) {
+        if (drain(batch, lastSecond, lastStamp) > 0) {
+            continue;
+        }
+        if (stopping) {
+            drain(batch, lastSecond, lastStamp); // flush on shutdown
+            return;
+        }
+        uint32_t seen = signal.load(std::memory_order_acquire);
+        sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with the fence in log()
+        if (isEmpty() && !stopping && binaryRequested.load(std::memory_order_acquire) == isBinary) {
+            signal.wait(seen, std::memory_order_acquire);
+        }
+        sleeping.store(false, std::memory_order_relaxed);
+    }
 }
\ No newline at end of file
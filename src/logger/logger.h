@@ -6,14 +6,53 @@
 #include <ctime>
 #include <chrono>
 #include <string>
-#include <map>
+#include <string_view>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <thread>
 #include <iomanip>
+#include <algorithm>
+#include <concepts>
+#include <cstring>
+#include <type_traits>
 
+// Messages below this level are removed at compile time: 0 - DEBUG, 1 - INFO, 2 - WARNING, 3 - ERROR
+#ifndef LOG_COMPILED_LEVEL
+#define LOG_COMPILED_LEVEL 0
+#endif
+
+// Format string known at compile time, "{}" is replaced with the next argument
+template<size_t N>
+struct formatString {
+    char text[N]{};
+
+    constexpr formatString(const char (&str)[N]) { // NOLINT: implicit for string literals
+        std::copy_n(str, N, text);
+    }
+
+    [[nodiscard]] constexpr size_t placeholders() const {
+        size_t count = 0;
+        for (size_t i = 0; i + 1 < N; ++i) {
+            count += text[i] == '{' && text[i + 1] == '}';
+        }
+        return count;
+    }
+};
+
+// Asynchronous logger: log() copies the message into a fixed-size record of a lock-free ring buffer,
+// a background thread formats the records and writes them to the file in batches.
+// LOGF() copies only the raw arguments, the text is made by the writer, or by logdecode in the binary mode.
 class Logger {
 public:
-    explicit Logger(const std::string &);
+    enum overflowPolicy {
+        BLOCK, // wait for a free record
+        DROP // lose the message, the number of lost messages is written later
+    };
+
+    explicit Logger(const std::string &, overflowPolicy = BLOCK, size_t capacity = 1 << 14);
 
-    ~Logger();
+    ~Logger(); // writes every queued record before closing the file
 
     enum logType {
         INFO,
@@ -22,16 +61,159 @@ public:
         ERROR
     };
 
-    void log(logType, const std::string &);
+    static constexpr int severity(logType type) {
+        return type == DEBUG ? 0 : type == INFO ? 1 : type == WARNING ? 2 : 3;
+    }
+
+    static constexpr bool isCompiled(logType type) {
+        return severity(type) >= LOG_COMPILED_LEVEL;
+    }
+
+    void log(logType, std::string_view);
+
+    template<logType type, formatString format, typename... Args>
+    void logf(const Args &...args) {
+        static_assert(format.placeholders() == sizeof...(Args), "Wrong number of log arguments");
+        if (!isEnabled(type)) {
+            return;
+        }
+        size_t pos;
+        record *current = claim(pos);
+        if (!current) {
+            return;
+        }
+        current->format = formatId<format>::id;
+        current->type = type;
+        size_t size = 0;
+        (encode(current->text, size, args), ...);
+        current->size = static_cast<uint16_t>(size);
+        commit(current, pos);
+    }
+
+    void setOverflowPolicy(overflowPolicy);
+
+    void setLevel(logType); // messages below the level are skipped at runtime
+
+    [[nodiscard]] bool isEnabled(logType type) const {
+        return severity(type) >= minSeverity.load(std::memory_order_relaxed);
+    }
+
+    void setBinary(const std::string &); // the following records go to the file in the binary format
+
+    // binary log file: MAGIC, then entries of
+    // 'F' u16 id, u16 size, text - definition of a format
+    // 'R' u16 format, u8 type, i64 nanoseconds since epoch, u16 size, arguments - one record
+    static constexpr std::string_view MAGIC = "TTTLOG1\n";
+    static constexpr uint16_t PLAIN = UINT16_MAX; // format of log(), the arguments are the text itself
+
+    static constexpr std::array<std::string_view, 4> logMapper{"INFO", "DEBUG", "WARNING", "ERROR"};
+
+    static std::string_view getFormat(uint16_t id);
+
+    static std::string timeStamp(std::time_t); // "%Y-%m-%d %H:%M:%S" in UTC
+
+    // appends the line of a record the same way as in the text log
+    static void render(std::string &, std::string_view stamp, logType, uint16_t format, std::string_view formatText,
+                       const char *args, size_t size);
 
 private:
-    std::ofstream logFile;
-    std::map<logType, std::string> logMapper{
-            {logType::INFO,    "INFO"},
-            {logType::DEBUG,   "DEBUG"},
-            {logType::WARNING, "WARNING"},
-            {logType::ERROR,   "ERROR"},
+    static constexpr size_t TEXTSIZE = 240; // longer messages are cut
+
+    struct record {
+        std::atomic<size_t> sequence; // ring position the record is ready for
+        std::chrono::system_clock::time_point time;
+        logType type;
+        uint16_t format;
+        uint16_t size;
+        char text[TEXTSIZE];
+    };
+
+    // arguments are tagged: 'i' - zigzag varint, 'u' - varint, 's' - u8 length and bytes
+    static void putVarint(char *out, size_t &size, uint64_t value) {
+        while (size < TEXTSIZE) {
+            out[size++] = static_cast<char>((value & 0x7F) | (value >= 0x80 ? 0x80 : 0));
+            value >>= 7;
+            if (value == 0) {
+                return;
+            }
+        }
+    }
+
+    template<typename T>
+    static void encode(char *out, size_t &size, const T &value) {
+        if (size + 2 > TEXTSIZE) {
+            return;
+        }
+        if constexpr (std::is_same_v<T, bool> || std::is_same_v<T, char>) {
+            encode(out, size, static_cast<int>(value));
+        } else if constexpr (std::signed_integral<T> || std::is_enum_v<T>) {
+            auto signedValue = static_cast<int64_t>(value);
+            out[size++] = 'i';
+            putVarint(out, size, (static_cast<uint64_t>(signedValue) << 1) ^ static_cast<uint64_t>(signedValue >> 63));
+        } else if constexpr (std::unsigned_integral<T>) {
+            out[size++] = 'u';
+            putVarint(out, size, value);
+        } else {
+            std::string_view str(value);
+            size_t length = std::min({str.size(), size_t{255}, TEXTSIZE - size - 2});
+            out[size++] = 's';
+            out[size++] = static_cast<char>(length);
+            memcpy(out + size, str.data(), length);
+            size += length;
+        }
+    }
+
+    static uint16_t registerFormat(const char *);
+
+    template<formatString format>
+    struct formatId { // every format gets its id once, at startup
+        static inline const uint16_t id = registerFormat(format.text);
     };
+
+    std::ofstream logFile;
+    std::atomic<overflowPolicy> policy;
+    std::atomic<int> minSeverity{0};
+
+    // bounded MPSC queue: producers claim positions with CAS, every record has its own sequence number
+    std::unique_ptr<record[]> ring;
+    size_t mask;
+    std::atomic<size_t> enqueuePos{0};
+    size_t dequeuePos = 0; // only the writer moves it
+    std::atomic<size_t> dropped{0};
+
+    std::atomic<bool> sleeping{false}; // writer waits for the signal
+    std::atomic<uint32_t> signal{0};
+    std::atomic<bool> stopping{false};
+    std::thread writer;
+
+    // binary mode, switched by the writer
+    std::string binaryPath;
+    std::atomic<bool> binaryRequested{false};
+    bool isBinary = false;
+    size_t formatsWritten = 0;
+
+    record *claim(size_t &pos);
+
+    void commit(record *, size_t pos);
+
+    bool isEmpty() const;
+
+    void wakeWriter();
+
+    void switchToBinary();
+
+    void writeRecord(std::string &batch, const record &, std::time_t &lastSecond, std::string &lastStamp);
+
+    size_t drain(std::string &batch, std::time_t &lastSecond, std::string &lastStamp);
+
+    void writeLoop();
 };
 
+#define LOGF(logger, type, format, ...)                                                   \
+    do {                                                                                  \
+        if constexpr (Logger::isCompiled(Logger::type)) {                                 \
+            (logger).logf<Logger::type, format>(__VA_ARGS__);                             \
+        }                                                                                 \
+    } while (false)
+
 #endif
\ No newline at end of file
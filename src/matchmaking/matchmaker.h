@@ -0,0 +1,180 @@
+#ifndef MATCHMAKER_H
+#define MATCHMAKER_H
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+// Waiting players in buckets of RATINGBAND Elo points. The rating difference a player accepts starts at
+// BASEWINDOW and widens by WIDENING every second of waiting, pair() matches the whole queue in one pass.
+// Every player is linked in its bucket and in the queue order, so push() and remove() are O(1).
+class matchmaker {
+public:
+    using clock = std::chrono::steady_clock;
+
+    static const int RATINGBAND = 100;
+    static const int BASEWINDOW = 100;
+    static const int WIDENING = 50; // per second of waiting
+
+private:
+    static const size_t BUCKETS = 40; // ratings from 4000 share the last bucket
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    struct link {
+        uint32_t prev = NONE;
+        uint32_t next = NONE;
+    };
+
+    struct list {
+        uint32_t head = NONE;
+        uint32_t tail = NONE;
+    };
+
+    struct entry {
+        int rating = 0;
+        clock::time_point since;
+        bool isWaiting = false;
+        link inBucket;
+        link inQueue;
+    };
+
+    std::vector<entry> entries; // by client index
+    std::array<list, BUCKETS> buckets;
+    list queue; // the oldest player first
+    size_t count = 0;
+
+    static size_t bucketOf(int rating) {
+        return std::min<size_t>(std::max(rating, 0) / RATINGBAND, BUCKETS - 1);
+    }
+
+    template<link entry::*member>
+    void append(list &to, uint32_t i) {
+        (entries[i].*member) = {to.tail, NONE};
+        if (to.tail != NONE) {
+            (entries[to.tail].*member).next = i;
+        } else {
+            to.head = i;
+        }
+        to.tail = i;
+    }
+
+    template<link entry::*member>
+    void unlink(list &from, uint32_t i) {
+        const link &current = entries[i].*member;
+        (current.prev != NONE ? (entries[current.prev].*member).next : from.head) = current.next;
+        (current.next != NONE ? (entries[current.next].*member).prev : from.tail) = current.prev;
+    }
+
+    [[nodiscard]] uint32_t find(size_t bucket, uint32_t i, int reach, clock::time_point now) const {
+        if (bucket >= BUCKETS) {
+            return NONE;
+        }
+        for (uint32_t j = buckets[bucket].head; j != NONE; j = entries[j].inBucket.next) {
+            if (j != i && std::abs(entries[j].rating - entries[i].rating) <= std::min(reach, window(entries[j], now))) {
+                return j;
+            }
+        }
+        return NONE;
+    }
+
+    [[nodiscard]] int window(const entry &player, clock::time_point now) const {
+        const auto waited = std::chrono::duration_cast<std::chrono::seconds>(now - player.since).count();
+        return BASEWINDOW + WIDENING * static_cast<int>(std::min<int64_t>(waited, 1000));
+    }
+
+public:
+    explicit matchmaker(size_t clients = 0) : entries(clients) {}
+
+    void push(int i, int rating, clock::time_point since) {
+        entry &player = entries[i];
+        if (player.isWaiting) {
+            return;
+        }
+        player.rating = rating;
+        player.since = since;
+        player.isWaiting = true;
+        append<&entry::inBucket>(buckets[bucketOf(rating)], i);
+        append<&entry::inQueue>(queue, i);
+        ++count;
+    }
+
+    void remove(int i) {
+        entry &player = entries[i];
+        if (!player.isWaiting) {
+            return;
+        }
+        unlink<&entry::inBucket>(buckets[bucketOf(player.rating)], i);
+        unlink<&entry::inQueue>(queue, i);
+        player.isWaiting = false;
+        --count;
+    }
+
+    [[nodiscard]] bool contains(int i) const {
+        return entries[i].isWaiting;
+    }
+
+    [[nodiscard]] size_t size() const {
+        return count;
+    }
+
+    [[nodiscard]] int oldest() const { // the queue must not be empty
+        return static_cast<int>(queue.head);
+    }
+
+    // also kept after remove() until the next push(), so a matched player still has it
+    [[nodiscard]] clock::time_point waitingSince(int i) const {
+        return entries[i].since;
+    }
+
+    // matches every pair whose rating difference both players accept, the nearest buckets are tried first;
+    // match(a, b) gets the players already removed from the queue
+    template<typename F>
+    size_t pair(clock::time_point now, F &&match) {
+        size_t pairs = 0;
+        for (size_t bucket = 0; bucket < BUCKETS && count >= 2; ++bucket) {
+            for (uint32_t i = buckets[bucket].head; i != NONE && count >= 2;) {
+                const entry &player = entries[i];
+                const int reach = window(player, now);
+                const auto span = static_cast<size_t>(reach / RATINGBAND + 1);
+                uint32_t partner = NONE;
+                for (size_t distance = 0; partner == NONE && distance <= span; ++distance) {
+                    partner = find(bucket + distance, i, reach, now);
+                    if (partner == NONE && distance > 0 && distance <= bucket) {
+                        partner = find(bucket - distance, i, reach, now);
+                    }
+                }
+                const uint32_t next = player.inBucket.next;
+                if (partner == NONE) {
+                    i = next;
+                    continue;
+                }
+                const uint32_t after = next == partner ? entries[partner].inBucket.next : next;
+                remove(static_cast<int>(i));
+                remove(static_cast<int>(partner));
+                match(static_cast<int>(i), static_cast<int>(partner));
+                ++pairs;
+                i = after;
+            }
+        }
+        return pairs;
+    }
+};
+
+// Elo rating change after one game
+namespace elo {
+    static const int K = 32;
+
+    // score of the first player: 1 - win, 0.5 - draw, 0 - loss
+    inline void update(int &first, int &second, double score) {
+        const double expected = 1 / (1 + std::pow(10.0, (second - first) / 400.0));
+        const int change = static_cast<int>(std::lround(K * (score - expected)));
+        first += change;
+        second -= change;
+    }
+}
+
+#endif
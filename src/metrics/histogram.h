@@ -0,0 +1,105 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+// Latency histogram with log-linear buckets like HdrHistogram: values below 64 are exact,
+// every next power of two is split into 32 buckets, so a percentile is off by at most 1/32.
+// record() is a relaxed atomic increment, any thread may record while another one reads.
+class histogram {
+public:
+    static constexpr size_t SUBBITS = 5;
+    static constexpr size_t SUBBUCKETS = 1 << SUBBITS;
+    static constexpr size_t EXACT = 2 * SUBBUCKETS; // values below are their own bucket
+    static constexpr size_t BUCKETS = EXACT + (64 - SUBBITS - 1) * SUBBUCKETS;
+
+    static constexpr size_t bucketOf(uint64_t value) {
+        if (value < EXACT) {
+            return value;
+        }
+        const size_t exponent = std::bit_width(value) - 1; // at least SUBBITS + 1
+        const size_t sub = (value >> (exponent - SUBBITS)) & (SUBBUCKETS - 1);
+        return EXACT + (exponent - SUBBITS - 1) * SUBBUCKETS + sub;
+    }
+
+    static constexpr uint64_t lowerBound(size_t bucket) { // smallest value of the bucket
+        if (bucket < EXACT) {
+            return bucket;
+        }
+        const size_t exponent = (bucket - EXACT) / SUBBUCKETS + SUBBITS + 1;
+        const uint64_t sub = (bucket - EXACT) % SUBBUCKETS;
+        return (uint64_t{1} << exponent) | (sub << (exponent - SUBBITS));
+    }
+
+    static constexpr uint64_t upperBound(size_t bucket) { // biggest value of the bucket
+        return bucket + 1 < BUCKETS ? lowerBound(bucket + 1) - 1 : UINT64_MAX;
+    }
+
+    void record(uint64_t value) {
+        counts[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+        for (uint64_t seen = maximum.load(std::memory_order_relaxed);
+             seen < value && !maximum.compare_exchange_weak(seen, value, std::memory_order_relaxed);) {
+        }
+    }
+
+    [[nodiscard]] uint64_t count() const {
+        return total.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] uint64_t getSum() const {
+        return sum.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] uint64_t max() const {
+        return maximum.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] uint64_t countAt(size_t bucket) const {
+        return counts[bucket].load(std::memory_order_relaxed);
+    }
+
+    // upper bound of the bucket holding the q-th fraction of values, 0 when empty
+    [[nodiscard]] uint64_t percentile(double q) const {
+        const uint64_t all = count();
+        if (all == 0) {
+            return 0;
+        }
+        const auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * static_cast<double>(all) + 0.5));
+        uint64_t seen = 0;
+        for (size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+            seen += countAt(bucket);
+            if (seen >= rank) {
+                return std::min(upperBound(bucket), max());
+            }
+        }
+        return max();
+    }
+
+    void merge(const histogram &other) {
+        for (size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+            if (uint64_t n = other.countAt(bucket)) {
+                counts[bucket].fetch_add(n, std::memory_order_relaxed);
+            }
+        }
+        total.fetch_add(other.count(), std::memory_order_relaxed);
+        sum.fetch_add(other.getSum(), std::memory_order_relaxed);
+        for (uint64_t seen = maximum.load(std::memory_order_relaxed), value = other.max();
+             seen < value && !maximum.compare_exchange_weak(seen, value, std::memory_order_relaxed);) {
+        }
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKETS> counts{};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> maximum{0};
+};
+
+#endif
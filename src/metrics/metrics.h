@@ -0,0 +1,80 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <initializer_list>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include "histogram.h"
+
+// Counters and gauges are relaxed atomics: one thread updates them, the exporter reads them at any time.
+class counter {
+private:
+    std::atomic<uint64_t> value{0};
+
+public:
+    void add(uint64_t n = 1) {
+        value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] uint64_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+};
+
+class gauge {
+private:
+    std::atomic<int64_t> value{0};
+
+public:
+    void set(int64_t current) {
+        value.store(current, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] int64_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+};
+
+// Prometheus text exposition format, version 0.0.4
+namespace prometheus {
+    inline std::string number(double value) { // shortest form, like 0.5 or 1.5e-05
+        std::ostringstream text;
+        text << std::setprecision(9) << value;
+        return text.str();
+    }
+
+    inline void header(std::string &out, std::string_view name, std::string_view type, std::string_view help) {
+        out.append("# HELP ").append(name).append(1, ' ').append(help).append(1, '\n');
+        out.append("# TYPE ").append(name).append(1, ' ').append(type).append(1, '\n');
+    }
+
+    inline void writeCounter(std::string &out, std::string_view name, std::string_view help, uint64_t value) {
+        header(out, name, "counter", help);
+        out.append(name).append(1, ' ').append(std::to_string(value)).append(1, '\n');
+    }
+
+    inline void writeGauge(std::string &out, std::string_view name, std::string_view help, int64_t value) {
+        header(out, name, "gauge", help);
+        out.append(name).append(1, ' ').append(std::to_string(value)).append(1, '\n');
+    }
+
+    // summary with the quantiles read from the histogram, scale converts its values to the unit of the name
+    inline void writeSummary(std::string &out, std::string_view name, std::string_view help, const histogram &values,
+                             double scale, std::initializer_list<double> quantiles = {0.5, 0.9, 0.99, 0.999}) {
+        header(out, name, "summary", help);
+        for (double q: quantiles) {
+            out.append(name).append("{quantile=\"").append(number(q)).append("\"} ")
+                    .append(number(static_cast<double>(values.percentile(q)) * scale)).append(1, '\n');
+        }
+        out.append(name).append("_sum ").append(number(static_cast<double>(values.getSum()) * scale))
+                .append(1, '\n');
+        out.append(name).append("_count ").append(std::to_string(values.count())).append(1, '\n');
+    }
+}
+
+#endif
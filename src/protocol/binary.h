@@ -0,0 +1,285 @@
+#ifndef BINARY_H
+#define BINARY_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "frame.h"
+
+// Compact encoding of the messages: one opcode byte and its arguments, cells are varints.
+// Text messages start with a printable char and opcodes are below it, so both encodings share one connection;
+// a client switches to the binary one by sending its log or reg in it and gets binary answers from then on.
+namespace protocol {
+    enum opcode : uint8_t {
+        // client requests
+        LOG = 1, // login and password, both u8 length and bytes
+        REG = 2, // the same as LOG
+        PUT = 3, // varint cell
+        AGAIN = 4,
+        WATCH = 5, // varint session, the game is followed without playing
+        // server messages
+        STATUS = 16, // status code
+        MOVE = 17, // 'X' or 'O', varint cell
+        WIN = 18,
+        DRAW = 19,
+        LOCK = 20,
+        RESTART = 21, // varint board size, varint win length
+        DISCONNECT = 22,
+        SHUTDOWN = 23,
+        TIMEOUT = 24, // nobody was found in the queue limit, the player is out of the queue
+        GAME = 25 // varint id of the game for WATCH, sent to the players after RESTART
+    };
+
+    enum status : uint8_t {
+        OK, // 200
+        TAKEN, // 400 - login is already registered
+        WRONG_PASSWORD, // 401
+        NOT_FOUND, // 404
+        LOGGED, // 405 - user is already logged in
+        INVALID // 406 - login or password is empty, too long or has a forbidden char
+    };
+
+    static constexpr std::array<std::string_view, 6> STATUSTEXT{"200", "400", "401", "404", "405", "406"};
+
+    static const uint8_t TEXTSTART = ' ';
+
+    inline bool isBinary(std::string_view payload) {
+        return !payload.empty() && static_cast<uint8_t>(payload[0]) < TEXTSTART;
+    }
+
+    // text of the server messages without arguments
+    constexpr std::string_view eventText(opcode code) {
+        switch (code) {
+            case WIN:
+                return "win";
+            case DRAW:
+                return "draw";
+            case LOCK:
+                return "lock";
+            case DISCONNECT:
+                return "disconnect";
+            case SHUTDOWN:
+                return "shutdown";
+            case TIMEOUT:
+                return "timeout";
+            default:
+                return "";
+        }
+    }
+
+    // readers consume the payload and return false when it is too short
+    inline bool getVarint(std::string_view &payload, uint64_t &value) {
+        value = 0;
+        for (int shift = 0; !payload.empty() && shift < 64; shift += 7) {
+            const auto byte = static_cast<uint8_t>(payload.front());
+            payload.remove_prefix(1);
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    inline bool getString(std::string_view &payload, std::string_view &value) {
+        if (payload.empty() || payload.size() - 1 < static_cast<uint8_t>(payload.front())) {
+            return false;
+        }
+        value = payload.substr(1, static_cast<uint8_t>(payload.front()));
+        payload.remove_prefix(1 + value.size());
+        return true;
+    }
+
+    // decimal argument of a text request, false when it isn't a number
+    inline bool getNumber(std::string_view text, uint64_t &value) {
+        value = 0;
+        if (text.empty() || text.size() > 18 || text.find_first_not_of("0123456789") != std::string_view::npos) {
+            return false;
+        }
+        for (char digit: text) {
+            value = value * 10 + (digit - '0');
+        }
+        return true;
+    }
+
+    inline void putVarint(std::string &out, uint64_t value) {
+        for (; value >= 0x80; value >>= 7) {
+            out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    inline void putString(std::string &out, std::string_view value) {
+        value = value.substr(0, UINT8_MAX);
+        out.push_back(static_cast<char>(value.size()));
+        out.append(value);
+    }
+
+    // whole binary frame of a server message, built without heap allocation
+    class smallFrame {
+    private:
+        std::array<char, HEADERSIZE + 24> data{};
+        size_t size = HEADERSIZE;
+
+    public:
+        explicit smallFrame(opcode code) {
+            push(code);
+        }
+
+        smallFrame &push(uint8_t byte) {
+            data[size++] = static_cast<char>(byte);
+            return *this;
+        }
+
+        smallFrame &varint(uint64_t value) {
+            for (; value >= 0x80; value >>= 7) {
+                push((value & 0x7F) | 0x80);
+            }
+            return push(value);
+        }
+
+        [[nodiscard]] std::string_view view() {
+            data[0] = static_cast<char>((size - HEADERSIZE) >> 8);
+            data[1] = static_cast<char>((size - HEADERSIZE) & 0xFF);
+            return {data.data(), size};
+        }
+
+        [[nodiscard]] std::string_view payload() const {
+            return {data.data() + HEADERSIZE, size - HEADERSIZE};
+        }
+    };
+
+    // text request of a client in the binary encoding, false when it has none
+    inline bool requestToBinary(std::string_view text, std::string &out) {
+        out.clear();
+        const size_t space = text.find(' ');
+        const std::string_view command = text.substr(0, space);
+        std::string_view rest = space == std::string_view::npos ? std::string_view() : text.substr(space + 1);
+        if (command == "log" || command == "reg") {
+            const size_t split = rest.find(' ');
+            if (split == std::string_view::npos) {
+                return false;
+            }
+            out.push_back(static_cast<char>(command == "log" ? LOG : REG));
+            putString(out, rest.substr(0, split));
+            putString(out, rest.substr(split + 1));
+        } else if (command == "put" || command == "watch") {
+            uint64_t number = 0;
+            if (!getNumber(rest, number)) {
+                return false;
+            }
+            out.push_back(static_cast<char>(command == "put" ? PUT : WATCH));
+            putVarint(out, number);
+        } else if (command == "again") {
+            out.push_back(static_cast<char>(AGAIN));
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    // binary server message in the text encoding, false when it is broken
+    inline bool messageToText(std::string_view payload, std::string &out) {
+        out.clear();
+        if (payload.empty()) {
+            return false;
+        }
+        const auto code = static_cast<opcode>(payload.front());
+        payload.remove_prefix(1);
+        uint64_t first, second;
+        switch (code) {
+            case STATUS:
+                if (payload.empty() || static_cast<uint8_t>(payload.front()) >= STATUSTEXT.size()) {
+                    return false;
+                }
+                out = STATUSTEXT[static_cast<uint8_t>(payload.front())];
+                return true;
+            case MOVE:
+                if (payload.empty()) {
+                    return false;
+                }
+                out.push_back(payload.front());
+                payload.remove_prefix(1);
+                if (!getVarint(payload, first)) {
+                    return false;
+                }
+                out += std::to_string(first);
+                return true;
+            case RESTART:
+                if (!getVarint(payload, first) || !getVarint(payload, second)) {
+                    return false;
+                }
+                out = "restart";
+                if (first != 3 || second != 3) {
+                    out += " " + std::to_string(first) + " " + std::to_string(second);
+                }
+                return true;
+            default:
+                out = eventText(code);
+                return !out.empty();
+        }
+    }
+
+    // request of a client in either encoding, the views point into the message
+    struct request {
+        opcode code{}; // 0 for an unknown text command
+        std::string_view login;
+        std::string_view password;
+        uint64_t cell = 0;
+        uint64_t session = 0; // of watch
+    };
+
+    inline std::string_view nextToken(std::string_view &rest) { // words of a text request
+        rest.remove_prefix(std::min(rest.find_first_not_of(' '), rest.size()));
+        const size_t end = std::min(rest.find(' '), rest.size());
+        std::string_view token = rest.substr(0, end);
+        rest.remove_prefix(end);
+        return token;
+    }
+
+    // false when the arguments of the request are broken, the code is set anyway
+    inline bool parseRequest(std::string_view message, request &out) {
+        out = {};
+        if (isBinary(message)) {
+            out.code = static_cast<opcode>(message.front());
+            message.remove_prefix(1);
+            switch (out.code) {
+                case LOG:
+                case REG:
+                    return getString(message, out.login) && getString(message, out.password) &&
+                           !out.login.empty() && !out.password.empty();
+                case PUT:
+                    return getVarint(message, out.cell);
+                case WATCH:
+                    return getVarint(message, out.session);
+                default:
+                    return true;
+            }
+        }
+        const std::string_view command = nextToken(message);
+        if (command == "log" || command == "reg") {
+            out.code = command == "log" ? LOG : REG;
+            out.login = nextToken(message);
+            out.password = nextToken(message);
+            return !out.login.empty() && !out.password.empty();
+        }
+        if (command == "put") {
+            out.code = PUT;
+            return getNumber(nextToken(message), out.cell);
+        }
+        if (command == "watch") {
+            out.code = WATCH;
+            return getNumber(nextToken(message), out.session);
+        }
+        if (command == "again") {
+            out.code = AGAIN;
+        }
+        return true;
+    }
+}
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Every message is sent as a frame: 2 bytes of big-endian payload length followed by the payload.
+// TCP may split or merge frames, so the receiver collects bytes in a frameBuffer and extracts whole frames.
+namespace protocol {
+    static const size_t HEADERSIZE = 2;
+    static const size_t MAXPAYLOAD = 1023;
+
+    inline void appendFrame(std::string &out, std::string_view payload) {
+        out.push_back(static_cast<char>(payload.size() >> 8));
+        out.push_back(static_cast<char>(payload.size() & 0xFF));
+        out.append(payload);
+    }
+
+    inline std::string encodeFrame(std::string_view payload) {
+        std::string frame;
+        frame.reserve(HEADERSIZE + payload.size());
+        appendFrame(frame, payload);
+        return frame;
+    }
+
+    class frameBuffer {
+    private:
+        std::vector<char> data;
+        size_t head = 0; // first unread byte
+        size_t tail = 0; // end of received bytes
+        bool broken = false; // peer sent a frame longer than MAXPAYLOAD
+
+        // moves unread bytes to the front when the end is reached, does nothing the second time
+        void prepare() {
+            if (head == tail) {
+                head = tail = 0;
+            } else if (data.size() - tail < HEADERSIZE + MAXPAYLOAD) {
+                std::memmove(data.data(), data.data() + head, tail - head);
+                tail -= head;
+                head = 0;
+            }
+        }
+
+    public:
+        explicit frameBuffer(size_t capacity = 2 * (HEADERSIZE + MAXPAYLOAD)) : data(capacity) {}
+
+        // free space to recv() into; both prepare the buffer, so recv(fd, writePtr(), writeSize())
+        // is right in any order of evaluation of the arguments
+        char *writePtr() {
+            prepare();
+            return data.data() + tail;
+        }
+
+        [[nodiscard]] size_t writeSize() {
+            prepare();
+            return data.size() - tail;
+        }
+
+        void commit(size_t received) {
+            tail += received;
+        }
+
+        // extracts the next whole frame, the view is valid until the next writePtr() call
+        bool next(std::string_view &payload) {
+            if (tail - head < HEADERSIZE) {
+                return false;
+            }
+            const auto *header = reinterpret_cast<const unsigned char *>(data.data() + head);
+            size_t size = (static_cast<size_t>(header[0]) << 8) | header[1];
+            if (size > MAXPAYLOAD) {
+                broken = true;
+                return false;
+            }
+            if (tail - head < HEADERSIZE + size) {
+                return false;
+            }
+            payload = {data.data() + head + HEADERSIZE, size};
+            head += HEADERSIZE + size;
+            return true;
+        }
+
+        [[nodiscard]] std::string_view unread() const {
+            return {data.data() + head, tail - head};
+        }
+
+        [[nodiscard]] bool isBroken() const {
+            return broken;
+        }
+
+        void clear() {
+            head = tail = 0;
+            broken = false;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef OUTPUTQUEUE_H
+#define OUTPUTQUEUE_H
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <cerrno>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Bytes waiting for a non-blocking socket. Small frames of one tick are appended to the same segment,
+// shared frames (one copy for many receivers) are queued by reference; flush() sends everything it can
+// with one gathering sendmsg, the rest waits for the socket to become writable.
+namespace protocol {
+    class outputQueue {
+    private:
+        struct segment {
+            std::string own; // bytes only for this socket
+            std::shared_ptr<const std::string> shared; // used instead of own when set
+
+            [[nodiscard]] std::string_view bytes() const {
+                return shared ? std::string_view(*shared) : std::string_view(own);
+            }
+        };
+
+        static const size_t MAXSEGMENTS = 64; // iovecs per syscall
+
+        std::deque<segment> segments;
+        size_t offset = 0; // sent bytes of the first segment
+        size_t queued = 0; // unsent bytes of all segments
+
+    public:
+        void append(std::string_view frame) {
+            if (segments.empty() || segments.back().shared) {
+                segments.emplace_back();
+            }
+            segments.back().own.append(frame);
+            queued += frame.size();
+        }
+
+        void append(std::shared_ptr<const std::string> frame) {
+            queued += frame->size();
+            segments.push_back({{}, std::move(frame)});
+        }
+
+        [[nodiscard]] size_t size() const {
+            return queued;
+        }
+
+        [[nodiscard]] bool empty() const {
+            return queued == 0;
+        }
+
+        // false when the connection is broken, otherwise the unsent bytes stay queued
+        bool flush(int fd) {
+            while (queued > 0) {
+                iovec parts[MAXSEGMENTS];
+                size_t count = 0;
+                for (auto it = segments.begin(); it != segments.end() && count < MAXSEGMENTS; ++it, ++count) {
+                    std::string_view bytes = it->bytes();
+                    if (count == 0) {
+                        bytes.remove_prefix(offset);
+                    }
+                    parts[count] = {const_cast<char *>(bytes.data()), bytes.size()};
+                }
+                msghdr message{};
+                message.msg_iov = parts;
+                message.msg_iovlen = count;
+                ssize_t sent = sendmsg(fd, &message, MSG_NOSIGNAL | MSG_DONTWAIT);
+                if (sent < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return errno == EAGAIN || errno == EWOULDBLOCK;
+                }
+                consume(static_cast<size_t>(sent));
+            }
+            return true;
+        }
+
+        void consume(size_t sent) {
+            queued -= sent;
+            while (sent > 0) {
+                const size_t left = segments.front().bytes().size() - offset;
+                if (sent < left) {
+                    offset += sent;
+                    return;
+                }
+                sent -= left;
+                segments.pop_front();
+                offset = 0;
+            }
+        }
+
+        std::string take() { // unsent bytes, the queue becomes empty
+            std::string rest;
+            rest.reserve(queued);
+            for (const segment &current: segments) {
+                rest.append(current.bytes());
+            }
+            rest.erase(0, offset);
+            clear();
+            return rest;
+        }
+
+        void clear() {
+            segments.clear();
+            offset = 0;
+            queued = 0;
+        }
+    };
+}
+
+#endif
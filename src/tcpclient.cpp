@@ -23,6 +23,7 @@ namespace TicTacToe {
     class GameWindow : public Fl_Window { // Main widow with game
     private:
         const int BUTTON_SIZE = 100;
+        const int MIN_BUTTON_SIZE = 30;
         int _cells;
         std::vector<std::unique_ptr<Fl_Button>> buttons; // buttons :)
         Fl_Box box{0, 0, 300, 50, "Your Turn"}; // box with info whose turn to move
@@ -30,8 +31,6 @@ namespace TicTacToe {
     public:
         explicit GameWindow(int cells = 3) try: Fl_Window(0, 0, "TicTacToe"), _cells(cells) {
             GenerateBoard();
-            this->resize(x(), y(), _cells * BUTTON_SIZE, _cells * BUTTON_SIZE + 150);
-            box.position(_cells * BUTTON_SIZE / 2 - 150, 50);
         } catch (std::exception &e) {
             std::cerr << e.what();
             logger.log(Logger::ERROR, e.what());
@@ -43,6 +42,24 @@ namespace TicTacToe {
             }
         }
 
+        [[nodiscard]] int buttonSize() const { // big boards get smaller buttons
+            return std::max(MIN_BUTTON_SIZE, BUTTON_SIZE * 3 / _cells);
+        }
+
+        void setBoardSize(int cells) { // server may host N x N boards
+            if (cells == _cells) {
+                return;
+            }
+            for (const auto &button: buttons) {
+                delete static_cast<cb *>(button->user_data());
+            }
+            buttons.clear();
+            _cells = cells;
+            begin();
+            GenerateBoard();
+            end();
+        }
+
         void restartGame() {
             locked = false;
             logger.log(Logger::DEBUG, "Locked = false");
@@ -51,6 +68,7 @@ namespace TicTacToe {
                 (*it)->copy_label("");
                 (*it)->activate();
                 (*it)->align(FL_ALIGN_INSIDE | FL_ALIGN_WRAP | FL_ALIGN_CLIP);
+                delete static_cast<cb *>((*it)->user_data()); // callback of the previous game
                 (*it)->callback(
                         [](Fl_Widget *sender, void *data) { // add an onClick event to send the message to the server
                             auto func = static_cast<std::function<void()> *>(data);
@@ -64,14 +82,17 @@ namespace TicTacToe {
         }
 
         void GenerateBoard() {
+            const int size = buttonSize();
             for (int i = 0; i < _cells; ++i) {
                 for (int j = 0; j < _cells; ++j) {
                     buttons.emplace_back(
-                            std::make_unique<Fl_Button>(BUTTON_SIZE * j, BUTTON_SIZE * i + 150,
-                                                        BUTTON_SIZE, BUTTON_SIZE)
+                            std::make_unique<Fl_Button>(size * j, size * i + 150,
+                                                        size, size)
                     );
                 }
             }
+            this->resize(x(), y(), _cells * size, _cells * size + 150);
+            box.position(_cells * size / 2 - 150, 50);
             logger.log(Logger::DEBUG, "Board generated.");
         }
 
@@ -169,6 +190,8 @@ namespace TicTacToe {
                         std::string status = socket.getMessage();
                         if (status == "400") {
                             fl_message("Login already used!");
+                        } else if (status == "406") {
+                            fl_message("Login or password is too long!");
                         } else if (status == "200") {
                             fl_message("Successfully registered!");
                             this->hide();
@@ -198,7 +221,11 @@ namespace TicTacToe {
         while (socket.isActive) {
             std::string data = socket.getMessage(); // unlock when get a message
 
-            if (data == "restart") {
+            if (data.starts_with("restart")) { // "restart" or "restart <board size> <win length>"
+                std::istringstream iss{data.substr(strlen("restart"))};
+                int cells = 3;
+                iss >> cells;
+                gameWindow.setBoardSize(cells);
                 gameWindow.restartGame();
                 gameWindow.show();
                 waitingWindow.hide();
@@ -206,6 +233,11 @@ namespace TicTacToe {
                 continue;
             }
 
+            if (data.starts_with("game ")) { // id of the game, others watch it by "watch <id>"
+                gameWindow.copy_label(("TicTacToe, game " + data.substr(strlen("game "))).c_str());
+                continue;
+            }
+
             if (data == "lock") { // lock random client
                 gameWindow.locked = true;
                 gameWindow.setBox();
@@ -226,6 +258,16 @@ namespace TicTacToe {
                 continue;
             }
 
+            if (data == "timeout") { // the server stopped looking for an opponent
+                logger.log(Logger::DEBUG, "Queue timeout.");
+                waitingWindow.hide();
+                if (fl_choice("No opponent was found. Would you like to wait again?", fl_no, fl_yes, nullptr) == 1) {
+                    socket.sendMessage("again");
+                    waitingWindow.show();
+                }
+                continue;
+            }
+
             if (data == "shutdown") {
                 logger.log(Logger::INFO, "Shutdown.");
                 fl_message("Server is down.");
@@ -1,5 +1,11 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <dirent.h>
+#include <poll.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <iostream>
 #include <fstream>
@@ -8,132 +14,1803 @@
 #include <chrono>
 #include <random>
 #include <thread>
-#include <map>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
 #include <unordered_map>
 #include <array>
-#include <list>
 #include <algorithm>
+#include <climits>
+#include <charconv>
 
 #include "userData.h"
+#include "userJournal.h"
+#include "userStore.h"
 #include "logger.h"
-#include "gameSession.h"
+#include "sessionPool.h"
+#include "perfectPlay.h"
+#include "frame.h"
+#include "binary.h"
+#include "outputQueue.h"
+#include "botWorker.h"
+#include "matchmaker.h"
+#include "metrics.h"
+#include "gameArchive.h"
+#include "timerWheel.h"
+#include "sharedState.h"
+#include "playerChannel.h"
+#include "sessionCheckpoint.h"
+
+thread_local std::mt19937_64 rng(std::chrono::high_resolution_clock::now().time_since_epoch().count());
 
-std::mt19937_64 rng(std::chrono::high_resolution_clock::now().time_since_epoch().count());
+namespace TicTacToeServer {
+
+    Logger logger("server.log");
+
+    using clock = std::chrono::steady_clock;
+
+    inline uint64_t nanoseconds(clock::duration time) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+    }
+
+    struct suspendedGame { // a game of the last run of the server, waiting for its players to log in again
+        checkpoint::game saved;
+        int holder = -1; // slot of the player who came back first, it waits in its reactor
+        size_t reactor = 0; // the one of holder
+    };
+
+    struct handoff { // waiting player or spectator moving between reactors
+        int fd;
+        userData *user;
+        std::string login;
+        std::string unread; // received bytes that were not handled yet
+        std::string unsent; // answers the socket didn't take yet
+        clock::time_point queuedAt;
+        bool binary;
+        size_t watch = SIZE_MAX; // local session a spectator goes to, SIZE_MAX - a waiting player
+        std::shared_ptr<suspendedGame> resume; // the game of the last run a player goes to, its holder is here
+        int parkedIn = -1; // epoll of the reactor that watches the player in the lobby for a hangup
+
+        handoff(int fd, userData *user, std::string login, std::string unread, std::string unsent,
+                clock::time_point queuedAt, bool binary) :
+                fd(fd), user(user), login(std::move(login)), unread(std::move(unread)), unsent(std::move(unsent)),
+                queuedAt(queuedAt), binary(binary) {}
+    };
+
+    class serverSocket {
+    private:
+        class reactor { // event loop thread with its own slice of connections and gameSessions
+        private:
+            serverSocket &server;
+            size_t id;
+
+            static constexpr size_t NOSESSION = SIZE_MAX;
+
+            struct connection { // everything the handlers need about a client, indexed by its slot
+                int fd = 0; // 0 - free slot
+                userData *user = nullptr; // logged-in user, states never move
+                std::string login; // of the user, games are saved with it
+                size_t session = NOSESSION; // the game being played
+                int peer = sessionPool::NOUSER; // the other player of the session or BOT
+                size_t watching = NOSESSION; // the game followed as a spectator
+                std::shared_ptr<suspendedGame> resuming; // the game of the last run it waits in for the other player
+                bool binary = false; // client talks in the binary encoding
+                bool isDirty = false; // has output of this tick, listed in dirty
+                bool isWaitingOut = false; // output waits for EPOLLOUT
+                protocol::frameBuffer inbox; // received bytes
+                protocol::outputQueue outbox; // frames not sent yet
+            };
+
+            sessionPool sessions;
+            matchmaker waiting; // players looking for a game
+            clock::time_point parkedDeadline = clock::time_point::max(); // queue deadline of the player sent to the lobby
+            handoff *parked = nullptr; // the player this reactor sent to the lobby, compared only, it may be taken
+            clock::time_point pairDeadline = clock::time_point::max(); // the next try to pair the ones left waiting
+            timerWheel timers; // the deadline of the state of every connection, by slot
+            std::unique_ptr<checkpoint::writer> checkpoints; // games of this reactor, nullptr - they are not saved
+            std::string checkpointBuffer; // payload of the last checkpoint, reused
+            clock::time_point checkpointDeadline = clock::time_point::max();
+
+            std::unique_ptr<botWorker> bot; // searches bot moves in its own thread
+
+            struct registration {
+                int slot;
+                int fd;
+                uint64_t seq; // journal record to wait for
+            };
+            std::vector<registration> unsynced;
+
+            std::mutex arrivalsMutex;
+            std::vector<handoff *> arrivals; // spectators sent by other reactors to the sessions of this one
+
+            static const int MAXEVENTS = 64;
+            static const uint64_t MASTER_ID = UINT64_MAX; // epoll tag of the master socket
+            static const uint64_t WAKE_ID = UINT64_MAX - 1; // epoll tag of wake_fd
+            static const uint64_t CLUSTER_ID = UINT64_MAX - 2; // epoll tag of the channel of the cluster
+            static const uint64_t PARKED_ID = UINT64_MAX - 3; // epoll tag of the player sent to the lobby
+            static constexpr int BOT = -1; // user of a session played by the server
+            static constexpr std::chrono::seconds PAIRINTERVAL{1}; // the rating windows widen every second
+
+            // Socket vars
+            int opt = 1;
+            int master_socket{};
+            int epoll_fd{};
+            int wake_fd{}; // eventfd signaled by other threads
+            int addrLen;
+            int max_clients;
+            std::vector<connection> connections; // by slot, like the epoll tags
+            std::vector<int> freeSlots; // stack of free slots in connections
+            std::vector<int> dirty; // connections with output, flushed once at the end of the tick
+            ssize_t valread{};
+            sockaddr_in address{};
+
+            std::array<epoll_event, MAXEVENTS> events{};
+
+            std::thread th;
+
+            void createMasterSocket() {
+                master_socket = socket(
+                        AF_INET,
+                        SOCK_STREAM,
+                        0);
+                if (master_socket < 0) {
+                    throw std::invalid_argument("Can't create master socket");
+                }
+                logger.log(Logger::INFO, "Create master socket: OK.");
+            }
+
+            void createDescriptor() {
+                // every reactor binds its own master socket to the same port, the kernel balances the connections
+                for (int option: {SO_REUSEADDR, SO_REUSEPORT}) {
+                    if (setsockopt(master_socket,
+                                   SOL_SOCKET,
+                                   option,
+                                   &opt,
+                                   sizeof(opt)
+                    ) < 0) {
+                        throw std::invalid_argument("Can't create socket descriptor");
+                    }
+                }
+                logger.log(Logger::INFO, "Create descriptor: OK.");
+            }
+
+            void bindSocket() {
+                if (bind(master_socket,
+                         (struct sockaddr *) &address,
+                         sizeof(address)
+                ) < 0) {
+                    throw std::invalid_argument("Can't bind socket");
+                }
+                logger.log(Logger::INFO, "Binding: OK.");
+            }
+
+            void listenSocket() const {
+                if (listen(master_socket, max_clients + 1) < 0) {
+                    throw std::invalid_argument("Listen error");
+                }
+                logger.log(Logger::INFO, "Listening: OK.");
+            }
+
+            void createEpoll() {
+                epoll_fd = epoll_create1(0);
+                if (epoll_fd < 0) {
+                    throw std::invalid_argument("Can't create epoll");
+                }
+                // edge-triggered: accept until EAGAIN on every notification
+                fcntl(master_socket, F_SETFL, fcntl(master_socket, F_GETFL) | O_NONBLOCK);
+                epoll_event ev{EPOLLIN | EPOLLET, {.u64 = MASTER_ID}};
+                if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, master_socket, &ev) < 0) {
+                    throw std::invalid_argument("Can't add master socket to epoll");
+                }
+
+                wake_fd = eventfd(0, EFD_NONBLOCK);
+                ev = {EPOLLIN | EPOLLET, {.u64 = WAKE_ID}};
+                if (wake_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev) < 0) {
+                    throw std::invalid_argument("Can't add wake descriptor to epoll");
+                }
+                logger.log(Logger::INFO, "Create epoll: OK.");
+            }
+
+            size_t acquireSession() { // never fails, the pool grows
+                size_t session = sessions.acquire();
+                sessions.setStartedAt(session, unixMilliseconds());
+                LOGF(logger, INFO, "Session {} in use, watch {}", session, watchId(session));
+                return session;
+            }
+
+            void releaseSession(const size_t session) { // after the spectators got the end of the game
+                for (int spectator: sessions.getSpectators(session)) {
+                    connections[spectator].watching = NOSESSION;
+                    startIdle(spectator);
+                }
+                sessions.release(session);
+                LOGF(logger, DEBUG, "Session {} is free.", session);
+            }
+
+            static uint64_t unixMilliseconds() {
+                return std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::system_clock::now().time_since_epoch()).count();
+            }
+
+            // result is told for player as if it moved first: the winner, the one who left or anybody of a draw
+            void archiveGame(const size_t session, const int player, const archive::outcome result) {
+                if (!server.games) {
+                    return;
+                }
+                const std::array<int, 2> &users = sessions.getUsers(session);
+                const int mover = sessions.getFirstMover(session);
+                const int first = mover != sessionPool::NOUSER ? mover : users[0];
+                const int second = users[users[0] == first];
+                archive::game record;
+                record.boardSize = static_cast<uint8_t>(server.boardSize);
+                record.winLength = static_cast<uint8_t>(server.winLength);
+                record.result = result;
+                if (player != first && result != archive::DRAW) { // the same result of the second player
+                    record.result = result == archive::FIRST_WON ? archive::SECOND_WON : archive::SECOND_LEFT;
+                }
+                record.startedAt = sessions.getStartedAt(session);
+                record.duration = unixMilliseconds() - sessions.getStartedAt(session);
+                record.players[0] = first == BOT ? std::string_view() : connections[first].login;
+                record.players[1] = second == BOT ? std::string_view() : connections[second].login;
+                server.games->append(record, sessions.getMoves(session));
+            }
+
+            [[nodiscard]] size_t watchId(const size_t session) const { // sessions of all reactors in one numbering
+                return session * server.reactors.size() + id;
+            }
+
+            // the spectator is moved to the reactor of the game, so moves are sent without crossing threads
+            void watch(const int i, const uint64_t game) {
+                if (connections[i].session != NOSESSION || connections[i].resuming) {
+                    LOGF(logger, WARNING, "Watch from the player {}", i);
+                    return;
+                }
+                stopWatching(i);
+                waiting.remove(i);
+                const size_t owner = game % server.reactors.size();
+                if (owner == id) {
+                    startWatching(i, game / server.reactors.size());
+                    return;
+                }
+                handoff *moving = detach(i);
+                moving->watch = game / server.reactors.size();
+                server.reactors[owner]->receive(moving);
+            }
+
+            void startWatching(const int i, const size_t session) {
+                if (session >= sessions.capacity() || !sessions.isUsed(session)) {
+                    sendStatus(i, protocol::NOT_FOUND);
+                    startIdle(i);
+                    return;
+                }
+                sendStatus(i, protocol::OK);
+                timers.cancel(i); // a spectator stays as long as there are games
+                connections[i].watching = session;
+                sessions.addSpectator(session, i);
+                sendRestart(i);
+                for (size_t cell = 0; cell < server.boardSize * server.boardSize; ++cell) { // the position so far
+                    if (const char player = sessions.getCell(session, cell); player != ' ') {
+                        sendMove(i, player, cell);
+                    }
+                }
+            }
+
+            void stopWatching(const int i) {
+                connection &client = connections[i];
+                if (client.watching == NOSESSION) {
+                    return;
+                }
+                sessions.removeSpectator(client.watching, i);
+                client.watching = NOSESSION;
+            }
+
+            // spectators of other reactors, a full reactor drops them
+            void takeArrivals() {
+                std::vector<handoff *> taken;
+                {
+                    std::lock_guard lock(arrivalsMutex);
+                    taken.swap(arrivals);
+                }
+                for (handoff *moving: taken) {
+                    if (!freeSlots.empty()) {
+                        adopt(moving);
+                        continue;
+                    }
+                    LOGF(logger, WARNING, "Too many clients, drop spectator {}", moving->fd);
+                    if (moving->user) {
+                        std::lock_guard lock(server.dbMutex);
+                        server.logOut(*moving->user);
+                    }
+                    close(moving->fd);
+                    delete moving;
+                }
+            }
+
+            // waiting players of other processes, sent here to be paired with the lonely one of this process
+            void takeTransfers() {
+                for (playerChannel::parcel parcel; server.channel->receive(parcel);) {
+                    if (parcel.fd < 0) {
+                        LOGF(logger, WARNING, "Broken player from another process");
+                        continue;
+                    }
+                    userData *user = server.welcome(parcel.login);
+                    if (!user || freeSlots.empty()) {
+                        LOGF(logger, WARNING, "Can't take {} from another process", parcel.login);
+                        if (user) {
+                            std::lock_guard lock(server.dbMutex);
+                            server.logOut(*user);
+                        }
+                        close(parcel.fd);
+                        continue;
+                    }
+                    LOGF(logger, INFO, "{} came from another process", parcel.login);
+                    adopt(new handoff{parcel.fd, user, parcel.login, std::move(parcel.unread),
+                                      std::move(parcel.unsent), clock::time_point(clock::duration(parcel.queuedAt)),
+                                      parcel.binary});
+                }
+            }
+
+            void joinSession(const int client, const size_t session, const int peer) {
+                stats.queueWait.record(nanoseconds(clock::now() - waiting.waitingSince(client)));
+                seat(client, session, peer);
+            }
+
+            void seat(const int client, const size_t session, const int peer) {
+                connections[client].user->isPlaying = true; // mark in the database as player
+                connections[client].session = session;
+                connections[client].peer = peer;
+                sessions.addUser(session, client);
+                timers.cancel(client); // the clock starts on its turn
+                sendRestart(client);
+                sendGame(client, session);
+            }
+
+            void leaveSession(const int client) {
+                connections[client].user->isPlaying = false;
+                connections[client].session = NOSESSION;
+                connections[client].peer = sessionPool::NOUSER;
+                startIdle(client);
+            }
+
+            void createSession(const int firstClient, const int secondClient) {
+                size_t i = acquireSession();
+                stats.matches.add();
+                LOGF(logger, DEBUG, "Pair {} and {}", firstClient, secondClient);
+                joinSession(firstClient, i, secondClient);
+                joinSession(secondClient, i, firstClient);
+                const int locked = rng() % 2 == 0 ? firstClient : secondClient;
+                sendEvent(locked, protocol::LOCK);
+                const int mover = locked == firstClient ? secondClient : firstClient;
+                sessions.setFirstMover(i, mover); // till the first move is made
+                startTurn(mover);
+            }
+
+            void createBotSession(const int client) { // the player waited too long and plays with the bot
+                waiting.remove(client);
+                size_t i = acquireSession();
+                stats.botMatches.add();
+                joinSession(client, i, BOT);
+                sessions.addUser(i, BOT);
+                LOGF(logger, INFO, "Bot plays with {} in session {}", client, i);
+                if (rng() % 2 == 0) { // bot moves first
+                    sessions.setBotSide(i, static_cast<int8_t>(sessions.getTurn(i)));
+                    sendEvent(client, protocol::LOCK);
+                    sessions.setFirstMover(i, BOT);
+                    askBot(i);
+                } else {
+                    sessions.setBotSide(i, static_cast<int8_t>(!sessions.getTurn(i)));
+                    sessions.setFirstMover(i, client);
+                    startTurn(client);
+                }
+            }
+
+            // the game of the last run goes on when its players are back, false - the user had none
+            bool resume(const int i) {
+                std::unique_lock lock(server.resumeMutex);
+                const auto found = server.suspended.find(connections[i].login);
+                if (found == server.suspended.end()) {
+                    return false;
+                }
+                const std::shared_ptr<suspendedGame> game = found->second;
+                const bool withBot = game->saved.players[0].empty() || game->saved.players[1].empty();
+                if (!withBot && game->holder < 0) { // the first one back waits for the other
+                    game->holder = i;
+                    game->reactor = id;
+                    lock.unlock();
+                    connections[i].resuming = game;
+                    setDeadline(i, server.resumeWait);
+                    LOGF(logger, INFO, "{} waits for the other player of its game", connections[i].login);
+                    return true;
+                }
+                server.forget(game->saved);
+                lock.unlock();
+                if (withBot) {
+                    restoreSession(game->saved, i, BOT);
+                } else if (game->reactor == id) {
+                    connections[game->holder].resuming.reset();
+                    restoreSession(game->saved, game->holder, i);
+                } else { // the game goes on in the reactor of the holder
+                    handoff *moving = detach(i);
+                    moving->resume = game;
+                    server.reactors[game->reactor]->receive(moving);
+                }
+                return true;
+            }
+
+            void joinHolder(const int i, const std::shared_ptr<suspendedGame> &game) { // came from another reactor
+                if (game->holder < 0) { // the holder left while this player was on the way
+                    LOGF(logger, INFO, "The other player of {} left", connections[i].login);
+                    sendEvent(i, protocol::DISCONNECT);
+                    startIdle(i);
+                    return;
+                }
+                connections[game->holder].resuming.reset();
+                restoreSession(game->saved, game->holder, i);
+            }
+
+            void leaveResume(const int i) { // the holder disconnected, the other player may become one
+                connection &client = connections[i];
+                if (!client.resuming) {
+                    return;
+                }
+                {
+                    std::lock_guard lock(server.resumeMutex);
+                    if (client.resuming->holder == i && client.resuming->reactor == id) {
+                        client.resuming->holder = -1;
+                    }
+                }
+                client.resuming.reset();
+            }
+
+            void giveUpResume(const int i) { // nobody came back for the holder in the resume wait
+                connection &client = connections[i];
+                {
+                    std::lock_guard lock(server.resumeMutex);
+                    const auto found = server.suspended.find(client.login);
+                    if (found == server.suspended.end() || found->second != client.resuming) {
+                        return; // the other player is on the way from another reactor
+                    }
+                    server.forget(client.resuming->saved);
+                }
+                LOGF(logger, INFO, "The other player of {} didn't come back", client.login);
+                client.resuming.reset();
+                sendEvent(i, protocol::DISCONNECT);
+                startIdle(i);
+            }
+
+            // the players get the saved game as a new one with all the moves made so far, b may be BOT
+            void restoreSession(const checkpoint::game &saved, const int a, const int b) {
+                const size_t session = acquireSession();
+                std::array<int, 2> order{}; // the first mover first
+                for (size_t k = 0; k < 2; ++k) {
+                    order[k] = saved.players[k].empty() ? BOT : saved.players[k] == connections[a].login ? a : b;
+                }
+                sessions.setStartedAt(session, saved.startedAt);
+                sessions.setFirstMover(session, order[0]);
+                sessions.setTurn(session, saved.firstTurn);
+                sessions.setBotSide(session, saved.botSide);
+                for (size_t k = 0; k < 2; ++k) {
+                    if (order[k] == BOT) {
+                        sessions.addUser(session, BOT);
+                        continue;
+                    }
+                    seat(order[k], session, order[1 - k]);
+                    if (k == 1) {
+                        sendEvent(order[k], protocol::LOCK);
+                    }
+                }
+                for (uint16_t cell: saved.moves) {
+                    if (!sessions.isFree(session, cell)) { // a broken game, it goes on from here
+                        break;
+                    }
+                    const char player = sessions.getTurn(session) ? 'X' : 'O';
+                    for (int user: order) {
+                        if (user >= 0) {
+                            sendMove(user, player, cell);
+                        }
+                    }
+                    sessions.setCell(session, cell);
+                }
+                LOGF(logger, INFO, "Session {} resumed after {} moves", session, sessions.getMoves(session).size());
+                if (const int next = order[sessions.getMoves(session).size() % 2]; next != BOT) {
+                    startTurn(next);
+                } else {
+                    askBot(session);
+                }
+            }
+
+            // the games of this reactor into its checkpoint, the first reactor also keeps the ones not resumed yet
+            void saveSessions() {
+                if (!checkpoints) {
+                    return;
+                }
+                checkpointBuffer.clear();
+                checkpoint::begin(checkpointBuffer, server.boardSize, server.winLength);
+                checkpoint::game saved;
+                size_t games = 0;
+                for (size_t session = 0; session < sessions.capacity(); ++session) {
+                    if (!sessions.isUsed(session)) {
+                        continue;
+                    }
+                    const std::array<int, 2> &users = sessions.getUsers(session);
+                    const int mover = sessions.getFirstMover(session);
+                    const int first = mover != sessionPool::NOUSER ? mover : users[0];
+                    const int order[2] = {first, users[users[0] == first]};
+                    const std::span<const uint16_t> moves = sessions.getMoves(session);
+                    saved.startedAt = sessions.getStartedAt(session);
+                    saved.firstTurn = sessions.getTurn(session) ^ (moves.size() & 1);
+                    saved.botSide = sessions.getBotSide(session);
+                    for (size_t k = 0; k < 2; ++k) {
+                        saved.players[k] = order[k] == BOT ? std::string() : connections[order[k]].login;
+                    }
+                    checkpoint::encode(checkpointBuffer, saved, moves);
+                    ++games;
+                }
+                if (id == 0) {
+                    std::lock_guard lock(server.resumeMutex);
+                    if (!server.suspended.empty() && clock::now() >= server.resumeUntil) {
+                        server.dropSuspended();
+                    }
+                    for (const auto &[login, game]: server.suspended) {
+                        const checkpoint::game &waiting = game->saved;
+                        if (login == waiting.players[waiting.players[0].empty()]) { // once for both of its logins
+                            checkpoint::encode(checkpointBuffer, waiting, waiting.moves);
+                            ++games;
+                        }
+                    }
+                }
+                checkpoints->write(checkpointBuffer);
+                LOGF(logger, DEBUG, "Checkpoint of reactor {}: {} games, {} bytes", id, games, checkpointBuffer.size());
+            }
+
+            void askBot(const size_t session) {
+                TicTacToe board = sessions.getBoard(session);
+                if (perfectPlay::covers(board)) { // classic board is solved, no need to search
+                    makeMove(session, perfectPlay::bestMove(board), BOT);
+                    return;
+                }
+                bot->post({session, sessions.getGeneration(session), std::move(board)});
+            }
+
+            void takeBotMoves() {
+                uint64_t signals;
+                read(wake_fd, &signals, sizeof(signals));
+                if (!bot) {
+                    return;
+                }
+                for (auto [session, generation, cell, stats]: bot->take()) {
+                    if (stats.playouts > 0) {
+                        LOGF(logger, DEBUG, "MCTS: {} playouts, {}/s on {} threads", stats.playouts,
+                             static_cast<uint64_t>(stats.playoutsPerSecond()), stats.threads);
+                    }
+                    if (sessions.isUsed(session) && sessions.getGeneration(session) == generation &&
+                        sessions.getBotSide(session) == sessions.getTurn(session) && sessions.isFree(session, cell)) {
+                        makeMove(session, cell, BOT);
+                    }
+                }
+            }
+
+            // the player parked in the lobby is taken back at its queue deadline, its timer fires at once
+            void takeBackParked() {
+                if (parkedDeadline > clock::now() || freeSlots.empty()) {
+                    return;
+                }
+                parkedDeadline = clock::time_point::max();
+                parked = nullptr;
+                if (handoff *waiting = server.takeParked()) {
+                    adopt(waiting);
+                }
+            }
+
+            // the parked player hung up or sent a request, it is handled here unless another reactor took it
+            void takeBackHungUp() {
+                if (!parked || freeSlots.empty()) { // a full reactor takes it back at its queue deadline
+                    return;
+                }
+                handoff *mine = std::exchange(parked, nullptr);
+                if (!server.lobby.compare_exchange_strong(mine, nullptr)) {
+                    return;
+                }
+                server.unwatch(mine);
+                const int i = adopt(mine);
+                readClient(i); // edge-triggered, the event was used by the lobby tag
+            }
+
+            void pairWaiting() { // Start gameSessions for every pair of waiting clients with close ratings
+                const auto now = clock::now();
+                waiting.pair(now, [this](int first, int second) { createSession(first, second); });
+                pairDeadline = waiting.size() >= 2 ? now + PAIRINTERVAL : clock::time_point::max();
+            }
+
+            // a connection has one deadline, the one of its state: logging in, idle, waiting or its turn
+            void setDeadline(const int i, const std::chrono::seconds timeout) { // 0 - no deadline
+                if (timeout.count() > 0) {
+                    timers.schedule(i, clock::now() + timeout);
+                } else {
+                    timers.cancel(i);
+                }
+            }
+
+            void startIdle(const int i) { // out of games and queues, a guest has to log in
+                setDeadline(i, connections[i].user ? server.idleTimeout : server.loginTimeout);
+            }
+
+            void startTurn(const int i) {
+                setDeadline(i, server.turnTime);
+            }
+
+            [[nodiscard]] clock::time_point queueDeadline(const clock::time_point since) const { // the bot or the limit
+                clock::time_point deadline = bot ? since + server.botWait : clock::time_point::max();
+                if (server.queueLimit.count() > 0) {
+                    deadline = std::min(deadline, since + server.queueLimit);
+                }
+                return deadline;
+            }
+
+            void startQueue(const int i) {
+                if (const clock::time_point deadline = queueDeadline(waiting.waitingSince(i));
+                        deadline != clock::time_point::max()) {
+                    timers.schedule(i, deadline);
+                } else {
+                    timers.cancel(i);
+                }
+            }
+
+            void expire(const int i) { // the deadline of the state the client is in now
+                connection &client = connections[i];
+                if (client.resuming) {
+                    giveUpResume(i);
+                } else if (client.session != NOSESSION) {
+                    forfeit(i);
+                } else if (waiting.contains(i)) {
+                    if (bot && clock::now() - waiting.waitingSince(i) >= server.botWait) {
+                        createBotSession(i);
+                        return;
+                    }
+                    LOGF(logger, INFO, "Nobody came for {} in the queue limit", i);
+                    waiting.remove(i);
+                    sendEvent(i, protocol::TIMEOUT);
+                    startIdle(i);
+                } else {
+                    LOGF(logger, INFO, "Drop {}: {}", i, client.user ? "idle" : "not logged in");
+                    disconnectClient(i);
+                }
+            }
+
+            void forfeit(const int i) { // the move clock ran out, the other player wins
+                const size_t session = connections[i].session;
+                const int peer = connections[i].peer;
+                LOGF(logger, INFO, "Player {} is out of time in session {}", i, session);
+                if (peer >= 0) {
+                    rateGame(peer, i, 1);
+                }
+                archiveGame(session, peer, archive::FIRST_WON);
+                finishSession(session, protocol::WIN);
+            }
+
+            void finishSession(const size_t session, const protocol::opcode result) { // players first, then spectators
+                for (auto user: sessions.getUsers(session)) {
+                    if (user >= 0) {
+                        sendEvent(user, result);
+                        leaveSession(user);
+                    }
+                }
+                broadcastEvent(session, result);
+                releaseSession(session);
+            }
+
+            [[nodiscard]] int timeout() const { // ms to the next deadline for epoll_wait, -1 - none
+                clock::time_point next = std::min({timers.nextDeadline(), pairDeadline, checkpointDeadline});
+                if (!freeSlots.empty()) { // a full reactor can't take the parked player back
+                    next = std::min(next, parkedDeadline);
+                }
+                if (next == clock::time_point::max()) {
+                    return -1;
+                }
+                const auto left = std::chrono::ceil<std::chrono::milliseconds>(next - clock::now()).count();
+                return static_cast<int>(std::clamp<int64_t>(left, 0, INT_MAX));
+            }
+
+            // mover is the client who made the move or BOT
+            void makeMove(const size_t session, const size_t cell, const int mover) {
+                const std::array<int, 2> &usersInSession = sessions.getUsers(session);
+
+                const char player = sessions.getTurn(session) ? 'X' : 'O';
+                for (auto user: usersInSession) {
+                    if (user >= 0) {
+                        sendMove(user, player, cell); // send a move to all users in the session
+                    }
+                }
+                broadcastMove(session, player, cell);
+
+                if (sessions.getMoves(session).empty()) { // the order of the players in the archive
+                    sessions.setFirstMover(session, mover);
+                }
+                sessions.setCell(session, cell); // setCell in local session
+                if (bool isWon = sessions.isWon(session), isDraw = sessions.isDraw(session); isWon || isDraw) {
+                    if (mover != BOT && usersInSession[0] >= 0 && usersInSession[1] >= 0) { // bot games are not rated
+                        const int other = usersInSession[usersInSession[0] == mover];
+                        rateGame(mover, other, isWon ? 1 : 0.5);
+                    }
+                    archiveGame(session, mover, isWon ? archive::FIRST_WON : archive::DRAW);
+                    finishSession(session, isWon ? protocol::WIN : protocol::DRAW); // if somebody win or draw
+                    return;
+                }
+                if (mover != BOT) {
+                    timers.cancel(mover);
+                }
+                if (const int next = usersInSession[usersInSession[0] == mover]; next != BOT) {
+                    startTurn(next);
+                } else if (sessions.getBotSide(session) == sessions.getTurn(session)) {
+                    askBot(session);
+                }
+            }
+
+            void rateGame(const int first, const int second, const double score) { // score of the first player
+                std::lock_guard lock(server.dbMutex); // ratings are saved by the compaction
+                elo::update(connections[first].user->rating, connections[second].user->rating, score);
+                for (const int player: {first, second}) {
+                    server.keepRating(connections[player].login, *connections[player].user);
+                }
+            }
+
+            void enqueue(const int i) {
+                const userData *user = connections[i].user;
+                // not logged in, in a game or waiting for a game of the last run
+                if (!user || connections[i].session != NOSESSION || connections[i].resuming) {
+                    return;
+                }
+                stopWatching(i); // a spectator wants to play
+                waiting.push(i, user->rating, clock::now());
+                startQueue(i);
+                LOGF(logger, INFO, "Pushing {} to queue with rating {}", i, user->rating);
+            }
+
+            // a single waiting player is exchanged through the lobby, so pairs are made across reactors
+            void shareLonelyPlayer() {
+                if (server.reactors.size() == 1 && !server.cluster) { // nobody else could take the player
+                    return;
+                }
+                while (waiting.size() == 1 && !freeSlots.empty()) {
+                    if (handoff *other = server.takeParked()) { // somebody is waiting in another reactor
+                        int lonely = waiting.oldest();
+                        int adopted = adopt(other); // queued with its own time, like every matched player
+                        waiting.remove(lonely);
+                        waiting.remove(adopted);
+                        createSession(lonely, adopted); // the rating doesn't matter for the only pair
+                        return;
+                    }
+                    const clock::time_point deadline = queueDeadline(waiting.waitingSince(waiting.oldest()));
+                    handoff *mine = detach(waiting.oldest());
+                    if (server.transfer(mine)) { // another process has a lonely player too
+                        return;
+                    }
+                    // watched before it is published, the reactor that takes it stops the watch
+                    epoll_event ev{EPOLLIN | EPOLLRDHUP | EPOLLET, {.u64 = PARKED_ID}};
+                    mine->parkedIn = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, mine->fd, &ev) == 0 ? epoll_fd : -1;
+                    handoff *expected = nullptr;
+                    if (server.lobby.compare_exchange_strong(expected, mine)) {
+                        parked = mine;
+                        parkedDeadline = deadline;
+                        if (server.cluster) { // the tickets are looked at again, two processes may announce at once
+                            server.cluster->announce();
+                            parkedDeadline = std::min(deadline, clock::now() + PAIRINTERVAL);
+                        }
+                        return;
+                    }
+                    server.unwatch(mine);
+                    adopt(mine); // lobby was taken in the meantime, try again
+                }
+            }
+
+            handoff *detach(const int i) { // take the client out of this reactor, it doesn't watch or play
+                connection &client = connections[i];
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client.fd, nullptr);
+                client.outbox.flush(client.fd);
+                auto *moving = new handoff{client.fd, client.user, client.login, std::string(client.inbox.unread()),
+                                           client.outbox.take(), waiting.waitingSince(i), client.binary};
+                LOGF(logger, DEBUG, "Move {} out of reactor {}", i, id);
+                waiting.remove(i);
+                timers.cancel(i);
+                client.user = nullptr;
+                client.fd = 0;
+                freeSlots.push_back(i);
+                return moving;
+            }
+
+            // take the client from the lobby into this reactor, returns its index
+            int adopt(handoff *moving) {
+                int i = addClient(moving->fd);
+                connection &client = connections[i];
+                memcpy(client.inbox.writePtr(), moving->unread.data(), moving->unread.size());
+                client.inbox.commit(moving->unread.size());
+                client.user = moving->user;
+                client.login = std::move(moving->login);
+                client.binary = moving->binary;
+                if (!moving->unsent.empty()) {
+                    queueOutput(i, moving->unsent);
+                }
+                if (moving->watch != NOSESSION) {
+                    startWatching(i, moving->watch);
+                } else if (moving->resume) {
+                    joinHolder(i, moving->resume);
+                } else {
+                    waiting.push(i, moving->user->rating, moving->queuedAt);
+                    startQueue(i);
+                }
+                LOGF(logger, DEBUG, "Move {} into reactor {}", i, id);
+                delete moving;
+                return i;
+            }
+
+            int addClient(const int fd) {
+                int i = freeSlots.back();
+                freeSlots.pop_back();
+                connection &client = connections[i];
+                client.fd = fd;
+                client.inbox.clear();
+                client.outbox.clear();
+                client.isWaitingOut = false;
+                client.binary = false;
+                client.user = nullptr;
+                client.login.clear();
+                client.resuming.reset();
+                client.session = NOSESSION;
+                client.peer = sessionPool::NOUSER;
+                client.watching = NOSESSION;
+                startIdle(i); // the time to log in
+
+                epoll_event ev{EPOLLIN | EPOLLRDHUP | EPOLLET, {.u64 = static_cast<uint64_t>(i)}};
+                if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                    throw std::invalid_argument("Can't add client socket to epoll");
+                }
+                return i;
+            }
+
+            void acceptConnections() {
+                while (true) { // edge-triggered, so drain the whole backlog
+                    int new_socket = accept4(
+                            master_socket,
+                            (struct sockaddr *) &address,
+                            (socklen_t *) &addrLen,
+                            SOCK_NONBLOCK); // answers are queued when the socket is full
+                    if (new_socket < 0) {
+                        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                            return;
+                        }
+                        if (errno == EINTR || errno == ECONNABORTED) {
+                            continue;
+                        }
+                        throw std::invalid_argument("Accept error");
+                    }
+
+                    std::cout << "New connection, socket fd: " << new_socket <<
+                              " ip: " << inet_ntoa(address.sin_addr) <<
+                              " port: " << ntohs(address.sin_port) << std::endl;
+                    LOGF(logger, DEBUG, "User {} is connected. IP: {}, Port: {}", new_socket, inet_ntoa(address.sin_addr),
+                         ntohs(address.sin_port));
+
+                    if (freeSlots.empty()) { // no place for a new client
+                        LOGF(logger, WARNING, "Too many clients, drop {}", new_socket);
+                        close(new_socket);
+                        continue;
+                    }
+
+                    int one = 1; // small messages go at once, "lock" must not wait for the ACK of "restart"
+                    setsockopt(new_socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+                    int i = addClient(new_socket);
+                    stats.connections.add();
+                    std::cout << "Adding to list of sockets as " << i << " in reactor " << id << std::endl;
+                    LOGF(logger, DEBUG, "Adding to list as {} in reactor {}", i, id);
+                }
+            }
+
+            void readClient(const int i) {
+                connection &client = connections[i];
+                const int sd = client.fd;
+                while (sd > 0 && client.fd == sd) { // edge-triggered, so read until EAGAIN
+                    valread = recv(sd, client.inbox.writePtr(), client.inbox.writeSize(), MSG_DONTWAIT);
+                    if (valread > 0) { // if got bytes, handle every whole message
+                        client.inbox.commit(valread);
+                        for (std::string_view message; client.fd == sd && client.inbox.next(message);) {
+                            handleMessage(i, message); // the view points into the inbox, nothing is copied
+                        }
+                        if (client.inbox.isBroken()) { // frame is too long, drop the client
+                            LOGF(logger, WARNING, "Bad frame from {}", i);
+                            disconnectClient(i);
+                        } else if (client.fd == sd && client.outbox.size() > server.outputLimit) {
+                            flushClient(i); // requests without reading the answers, don't wait for the tick end
+                        }
+                    } else if (valread < 0 && errno == EINTR) {
+                        continue;
+                    } else if (valread < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                        return;
+                    } else { // if client disconnect
+                        disconnectClient(i);
+                    }
+                }
+            }
+
+            void disconnectClient(const int i) {
+                connection &client = connections[i];
+                int sd = client.fd;
+                getpeername(sd,
+                            (struct sockaddr *) &address,
+                            (socklen_t *) &addrLen);
+                std::cout << "Host disconnected, ip: " << inet_ntoa(address.sin_addr) << " port: "
+                          << ntohs(address.sin_port) << std::endl;
+                LOGF(logger, DEBUG, "User {} is disconnected. IP: {}, Port: {}", i, inet_ntoa(address.sin_addr),
+                     ntohs(address.sin_port));
+                close(sd); // closing also removes the socket from epoll
+                client.fd = 0;
+                client.outbox.clear();
+                freeSlots.push_back(i);
+                stopWatching(i);
+                leaveResume(i);
+                if (const size_t session = client.session; session != NOSESSION) {
+                    archiveGame(session, i, archive::FIRST_LEFT);
+                    if (const int peer = client.peer; peer >= 0) { // tell the other player, no search needed
+                        sendEvent(peer, protocol::DISCONNECT);
+                        rateGame(peer, i, 1); // leaving loses the game
+                        leaveSession(peer);
+                    }
+                    leaveSession(i);
+                    broadcastEvent(session, protocol::DISCONNECT);
+                    releaseSession(session);
+                }
+                if (client.user) {
+                    std::lock_guard lock(server.dbMutex);
+                    server.logOut(*client.user);
+                    client.user = nullptr;
+                }
+                if (waiting.contains(i)) { // delete from waiting queue
+                    waiting.remove(i);
+                    LOGF(logger, DEBUG, "Pop {} from queue", i);
+                }
+                timers.cancel(i);
+            }
+
+            void handleMessage(const int i, std::string_view message) {
+                if (std::any_of(unsynced.begin(), unsynced.end(), [i](const registration &r) { return r.slot == i; })) {
+                    commitRegistrations(); // answers keep the order of requests
+                }
+                if (const connection &client = connections[i];
+                        client.user && client.session == NOSESSION && client.watching == NOSESSION && !client.resuming &&
+                        !waiting.contains(i)) { // only a logged-in client is kept alive by its messages
+                    startIdle(i);
+                }
+                const bool binary = protocol::isBinary(message);
+                if (binary) {
+                    connections[i].binary = true; // answers follow the encoding of the client
+                    LOGF(logger, DEBUG, "Got opcode {} from {}", static_cast<int>(message.front()), i);
+                } else {
+                    std::cout << "msg from client: " << message << std::endl;
+                    LOGF(logger, DEBUG, "Got message: {} from {}", message, i);
+                }
+                protocol::request request;
+                const bool isValid = protocol::parseRequest(message, request);
+                switch (request.code) {
+                    case protocol::LOG:
+                    case protocol::REG:
+                        if (!isValid) {
+                            LOGF(logger, WARNING, "No login or password from {}", i);
+                            return;
+                        }
+                        request.code == protocol::LOG ? logIn(i, request.login, request.password)
+                                                      : registerUser(i, request.login, request.password);
+                        break;
+                    case protocol::PUT: // inGame request
+                        if (!isValid) {
+                            LOGF(logger, WARNING, "Wrong move from {}", i);
+                            return;
+                        }
+                        {
+                            const auto start = clock::now();
+                            putMove(i, request.cell);
+                            stats.putLatency.record(nanoseconds(clock::now() - start));
+                        }
+                        break;
+                    case protocol::AGAIN:
+                        enqueue(i);
+                        break;
+                    case protocol::WATCH:
+                        if (!isValid) {
+                            LOGF(logger, WARNING, "No game to watch from {}", i);
+                            return;
+                        }
+                        watch(i, request.session);
+                        break;
+                    default:
+                        if (binary) { // unknown text commands are ignored
+                            LOGF(logger, WARNING, "Unknown opcode {} from {}", static_cast<int>(request.code), i);
+                        }
+                }
+            }
+
+            void logIn(const int i, std::string_view login, std::string_view password) {
+                std::unique_lock lock(server.dbMutex);
+                const userStore::record *found = server.findUser(login);
+                if (!found) { // no login in db
+                    lock.unlock();
+                    sendStatus(i, protocol::NOT_FOUND);
+                    return;
+                }
+                if (found->getPassword() != password) { // wrong password
+                    lock.unlock();
+                    sendStatus(i, protocol::WRONG_PASSWORD);
+                    return;
+                }
+                userData &state = server.stateOf(*found);
+                if (state.isLogged || !server.claim(state, login, password)) { // already logged here or elsewhere
+                    lock.unlock();
+                    sendStatus(i, protocol::LOGGED);
+                    return;
+                }
+                state.isLogged = true;
+                lock.unlock();
+
+                sendStatus(i, protocol::OK); // good login
+                stats.logins.add();
+                connections[i].user = &state; // states never move
+                connections[i].login = login;
+                if (!resume(i)) {
+                    enqueue(i);
+                }
+            }
+
+            void registerUser(const int i, std::string_view login, std::string_view password) {
+                if (!userStore::fits(login, password)) {
+                    sendStatus(i, protocol::INVALID);
+                    return;
+                }
+                std::unique_lock lock(server.dbMutex);
+                if (!server.newUser(login, password)) { // already registered
+                    lock.unlock();
+                    sendStatus(i, protocol::TAKEN);
+                    return;
+                }
+                const uint64_t seq = server.journal->append(login, password);
+                lock.unlock();
+                unsynced.push_back({i, connections[i].fd, seq}); // answered when the journal is synced
+            }
+
+            void commitRegistrations() { // one fdatasync for all registrations of the tick
+                if (unsynced.empty()) {
+                    return;
+                }
+                server.journal->flush(unsynced.back().seq);
+                for (auto [i, fd, seq]: unsynced) {
+                    if (connections[i].fd == fd) { // still the same client
+                        sendStatus(i, protocol::OK); // good registration
+                        stats.registrations.add();
+                    }
+                }
+                unsynced.clear();
+            }
+
+            void putMove(const int i, const size_t cell) { // inGame request
+                const size_t activeSession = connections[i].session; // no lookups on the way of a move
+                if (activeSession == NOSESSION) {
+                    return;
+                }
+                if (!sessions.isFree(activeSession, cell) ||
+                    sessions.getBotSide(activeSession) == sessions.getTurn(activeSession)) { // taken cell or bot turn
+                    LOGF(logger, WARNING, "Wrong move {} from {}", cell, i);
+                    return;
+                }
+
+                makeMove(activeSession, cell, i);
+            }
+
+            void run() try {
+                while (server.isActive) { // Socket Loop
+                    // sleep until the next deadline, other threads and the shutdown wake the loop through wake_fd
+                    int activity = epoll_wait(epoll_fd, events.data(), MAXEVENTS, timeout());
+                    if (activity < 0 && errno != EINTR) {
+                        throw std::invalid_argument("Epoll error");
+                    }
+
+                    for (int e = 0; e < activity; ++e) {
+                        if (events[e].data.u64 == MASTER_ID) { // new connections
+                            acceptConnections();
+                        } else if (events[e].data.u64 == WAKE_ID) { // bot made moves or spectators came
+                            takeBotMoves();
+                            takeArrivals();
+                        } else if (events[e].data.u64 == CLUSTER_ID) { // players of other processes
+                            takeTransfers();
+                        } else if (events[e].data.u64 == PARKED_ID) { // the player in the lobby
+                            takeBackHungUp();
+                        } else {
+                            const auto i = static_cast<int>(events[e].data.u64);
+                            if (events[e].events & EPOLLOUT) {
+                                flushClient(i);
+                            }
+                            if (events[e].events & ~EPOLLOUT) {
+                                readClient(i);
+                            }
+                        }
+                    }
 
-namespace TicTacToeServer {
+                    commitRegistrations();
 
-    Logger logger("server.log");
+                    pairWaiting();
+                    takeBackParked();
+                    timers.advance(clock::now(), [this](size_t i) { expire(static_cast<int>(i)); });
+                    if (checkpointDeadline <= clock::now()) {
+                        saveSessions();
+                        checkpointDeadline = clock::now() + server.checkpointInterval;
+                    }
+                    shareLonelyPlayer();
+                    queueSize = waiting.size();
+                    stats.connected.set(max_clients - static_cast<int64_t>(freeSlots.size()));
+                    stats.sessionsInUse.set(static_cast<int64_t>(sessions.size()));
+                    flushDirty();
+                }
+                saveSessions(); // the games go on after a restart
+            } catch (const std::exception &e) {
+                std::cerr << e.what();
+                logger.log(Logger::ERROR, e.what());
+                server.stop(); // one broken reactor stops the whole server
+            }
+
+        public:
+            std::atomic<size_t> queueSize = 0; // for console commands
+
+            struct reactorStats { // written by the reactor, read by the metrics exporter
+                counter connections; // accepted
+                counter logins;
+                counter registrations;
+                counter matches; // of two players
+                counter botMatches;
+                gauge connected; // clients in the reactor, updated every tick
+                gauge sessionsInUse;
+                histogram queueWait; // nanoseconds from the queueing to the game
+                histogram putLatency; // nanoseconds of handling a move, with sending it
+            } stats;
+
+            reactor(serverSocket &server, size_t id, int clients, size_t reservedSessions) :
+                    server(server), id(id), sessions(server.boardSize, server.winLength, reservedSessions),
+                    addrLen(sizeof(address)), max_clients(clients) {
+
+                connections.resize(max_clients);
+                waiting = matchmaker(max_clients);
+                timers = timerWheel(max_clients);
+                for (int i = max_clients - 1; i >= 0; --i) { // lowest index on the top
+                    freeSlots.push_back(i);
+                }
+
+                address = {AF_INET, htons(std::stoul(server.configData["PORT"])),
+                           {inet_addr(server.configData["HOST"].c_str())}, {}};
+
+                createMasterSocket();
+
+                createDescriptor();
+
+                bindSocket();
+
+                listenSocket();
+
+                createEpoll();
+
+                if (id == 0 && server.channel) { // the first reactor takes the players of the other processes
+                    epoll_event ev{EPOLLIN | EPOLLET, {.u64 = CLUSTER_ID}};
+                    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server.channel->descriptor(), &ev) < 0) {
+                        throw std::invalid_argument("Can't add cluster channel to epoll");
+                    }
+                }
+
+                if (!server.checkpointPath.empty()) { // the first checkpoint keeps the games not resumed yet
+                    checkpoints = std::make_unique<checkpoint::writer>(server.checkpointFile(id));
+                    saveSessions();
+                    if (server.checkpointInterval.count() > 0) {
+                        checkpointDeadline = clock::now() + server.checkpointInterval;
+                    }
+                }
+
+                if (server.botWait.count() > 0) {
+                    bot = std::make_unique<botWorker>(server.botMoveTime, server.botWorkers, server.botThreads,
+                                                    [this] { wake(); });
+                }
+            }
+
+            void start() {
+                th = std::thread(&reactor::run, this);
+            }
+
+            void wake() const {
+                uint64_t one = 1;
+                write(wake_fd, &one, sizeof(one));
+            }
+
+            void receive(handoff *moving) { // a spectator from another reactor
+                {
+                    std::lock_guard lock(arrivalsMutex);
+                    arrivals.push_back(moving);
+                }
+                wake();
+            }
+
+            void join() {
+                if (th.joinable()) {
+                    th.join();
+                }
+            }
+
+            ~reactor() {
+                bot.reset(); // stop searching before wake_fd is closed
+                for (int i = 0; i < max_clients; ++i) {
+                    if (connections[i].fd > 0) {
+                        sendEvent(i, protocol::SHUTDOWN);
+                        connections[i].outbox.flush(connections[i].fd); // once, a full socket loses the rest
+                        close(connections[i].fd);
+                    }
+                }
+                for (handoff *moving: arrivals) { // spectators sent after the loop stopped
+                    close(moving->fd);
+                    delete moving;
+                }
+                LOGF(logger, INFO, "All clients of reactor {} disconnected.", id);
+                close(wake_fd);
+                close(epoll_fd);
+                // closing the listening socket
+                shutdown(master_socket, SHUT_RDWR);
+                close(master_socket);
+            }
+
+            // output is queued and sent at the end of the tick, so messages of one tick share a syscall
+            void queueOutput(const int idx, std::string_view bytes) {
+                connections[idx].outbox.append(bytes);
+                markDirty(idx);
+            }
+
+            void queueOutput(const int idx, std::shared_ptr<const std::string> frame) { // queued by reference
+                connections[idx].outbox.append(std::move(frame));
+                markDirty(idx);
+            }
+
+            void markDirty(const int idx) {
+                connection &client = connections[idx];
+                if (!client.isDirty) {
+                    client.isDirty = true;
+                    dirty.push_back(idx);
+                }
+            }
+
+            void sendMessage(const int idx, std::string_view message) {
+                char header[protocol::HEADERSIZE] = {static_cast<char>(message.size() >> 8),
+                                                     static_cast<char>(message.size() & 0xFF)};
+                queueOutput(idx, {header, protocol::HEADERSIZE});
+                queueOutput(idx, message);
+                LOGF(logger, DEBUG, "Send {} to {}", message, idx);
+            }
+
+            void sendBinary(const int idx, protocol::smallFrame &frame) {
+                queueOutput(idx, frame.view());
+                LOGF(logger, DEBUG, "Send opcode {} to {}", static_cast<int>(frame.payload().front()), idx);
+            }
+
+            void watchOutput(const int i, const bool isWaiting) { // EPOLLOUT only while the socket is full
+                connection &client = connections[i];
+                if (client.isWaitingOut == isWaiting) {
+                    return;
+                }
+                client.isWaitingOut = isWaiting;
+                epoll_event ev{EPOLLIN | EPOLLRDHUP | EPOLLET | (isWaiting ? EPOLLOUT : 0u),
+                               {.u64 = static_cast<uint64_t>(i)}};
+                epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client.fd, &ev);
+            }
+
+            void flushClient(const int i) {
+                connection &client = connections[i];
+                if (client.fd <= 0) {
+                    return;
+                }
+                if (!client.outbox.flush(client.fd)) {
+                    disconnectClient(i);
+                    return;
+                }
+                if (client.watching != NOSESSION && client.outbox.size() > server.spectatorLimit) { // players don't wait
+                    LOGF(logger, WARNING, "Spectator {} is too slow: {} bytes", i, client.outbox.size());
+                    disconnectClient(i);
+                    return;
+                }
+                if (client.outbox.size() > server.outputLimit) { // the client doesn't read its messages
+                    LOGF(logger, WARNING, "Output of {} is over the limit: {} bytes", i, client.outbox.size());
+                    disconnectClient(i);
+                    return;
+                }
+                watchOutput(i, !client.outbox.empty());
+            }
+
+            void flushDirty() {
+                for (size_t k = 0; k < dirty.size(); ++k) { // a disconnect may add the peer
+                    const int i = dirty[k];
+                    connections[i].isDirty = false;
+                    if (!connections[i].isWaitingOut) { // otherwise EPOLLOUT comes when there is space
+                        flushClient(i);
+                    }
+                }
+                dirty.clear();
+            }
+
+            void sendStatus(const int idx, const protocol::status code) {
+                if (!connections[idx].binary) {
+                    sendMessage(idx, protocol::STATUSTEXT[code]);
+                    return;
+                }
+                protocol::smallFrame frame(protocol::STATUS);
+                sendBinary(idx, frame.push(code));
+            }
+
+            void sendEvent(const int idx, const protocol::opcode code) { // message without arguments
+                if (!connections[idx].binary) {
+                    sendMessage(idx, protocol::eventText(code));
+                    return;
+                }
+                protocol::smallFrame frame(code);
+                sendBinary(idx, frame);
+            }
+
+            void sendMove(const int idx, const char player, const size_t cell) {
+                if (!connections[idx].binary) {
+                    sendMessage(idx, player + std::to_string(cell));
+                    return;
+                }
+                protocol::smallFrame frame(protocol::MOVE);
+                sendBinary(idx, frame.push(player).varint(cell));
+            }
+
+            // every spectator gets the same frame, each encoding is made once and shared by the queues
+            void broadcast(const size_t session, std::string_view text, protocol::smallFrame &frame) {
+                std::shared_ptr<const std::string> textFrame, binaryFrame;
+                for (int spectator: sessions.getSpectators(session)) {
+                    std::shared_ptr<const std::string> &shared = connections[spectator].binary ? binaryFrame : textFrame;
+                    if (!shared) {
+                        shared = std::make_shared<const std::string>(
+                                connections[spectator].binary ? std::string(frame.view()) : protocol::encodeFrame(text));
+                    }
+                    queueOutput(spectator, shared);
+                }
+            }
+
+            void broadcastEvent(const size_t session, const protocol::opcode code) {
+                if (sessions.getSpectators(session).empty()) {
+                    return;
+                }
+                protocol::smallFrame frame(code);
+                broadcast(session, protocol::eventText(code), frame);
+            }
+
+            void broadcastMove(const size_t session, const char player, const size_t cell) {
+                if (sessions.getSpectators(session).empty()) {
+                    return;
+                }
+                protocol::smallFrame frame(protocol::MOVE);
+                broadcast(session, player + std::to_string(cell), frame.push(player).varint(cell));
+            }
+
+            void sendRestart(const int idx) {
+                if (!connections[idx].binary) {
+                    sendMessage(idx, server.restartMessage);
+                    return;
+                }
+                protocol::smallFrame frame(protocol::RESTART);
+                sendBinary(idx, frame.varint(server.boardSize).varint(server.winLength));
+            }
+
+            void sendGame(const int idx, const size_t session) { // the id others watch the game by
+                if (!connections[idx].binary) {
+                    sendMessage(idx, "game " + std::to_string(watchId(session)));
+                    return;
+                }
+                protocol::smallFrame frame(protocol::GAME);
+                sendBinary(idx, frame.varint(watchId(session)));
+            }
+        };
 
-    class serverSocket {
-    private:
         std::unordered_map<std::string, std::string> configData; // container with data from config
-        std::map<std::string, userData> db; // DataBase
-        std::map<int, std::string> clientLogin; // socketID -> login
-
-        std::vector<gameSession> gameSessions;
-        std::vector<bool> isSessionUsed;
-        std::list<int> waitingQueue;
-
-        static const int BUFFERSIZE = 1024;
-
-        // Socket vars
-        int opt = 1;
-        int master_socket{};
-        int addrLen;
-        int max_clients;
-        std::vector<int> client_sockets;
-        int new_socket;
-        int activity;
-        int max_sd;
-        ssize_t valread{};
-        sockaddr_in address{};
-        timeval tv{0, 500000};
-
-        fd_set readfds{};
-        fd_set writefds{};
-
-        char buffer[BUFFERSIZE] = {0};
-
-        bool isActive = true; // Socket state
-
-        void createMasterSocket() {
-            master_socket = socket(
-                    AF_INET,
-                    SOCK_STREAM,
-                    0);
-            if (master_socket == 0) {
-                throw std::invalid_argument("Can't create master socket");
-            }
-            logger.log(Logger::INFO, "Create master socket: OK.");
+        std::unique_ptr<userStore> db; // DataBase: logins and passwords
+        std::unordered_map<uint32_t, userData> userStates; // by registration number, made on the first use
+        std::mutex dbMutex; // guards db, userStates and isLogged, the rest of a state belongs to its reactor
+        std::unique_ptr<userJournal> journal; // registrations since the last snapshot
+        std::unique_ptr<archive::writer> games; // finished games, nullptr - they are not kept
+        std::atomic<bool> ratingsChanged = false; // ratings are saved only in the snapshot
+        uint64_t changeCursor = 0; // the next change of the cluster to save, under dbMutex
+        std::unique_ptr<sharedState> cluster; // users and lonely players of the processes on one port, nullptr - alone
+        std::unique_ptr<playerChannel> channel; // waiting players sent to and from the other processes
+
+        static constexpr const char *DBPATH = ".db"; // text "login:password" lines, read when there is no snapshot
+        static constexpr const char *STOREPATH = ".db.store"; // snapshot
+        static constexpr const char *JOURNALPATH = ".db.wal";
+        static constexpr const char *OLDJOURNALPATH = ".db.wal.old"; // journal being compacted
+
+        std::chrono::seconds compactInterval{60}; // 0 - snapshot only on startup after a crash
+        std::thread publisher; // shares the users of this process with the cluster after the start
+        std::thread compactor;
+        std::mutex compactMutex;
+        std::condition_variable compactSignal;
+
+        std::vector<std::unique_ptr<reactor>> reactors;
+
+        size_t outputLimit = 64 * 1024; // unsent bytes of a client before it is dropped
+        size_t spectatorLimit = 16 * 1024; // the same for a spectator, a whole game is a few KB
+        uint16_t metricsPort = 0; // 0 - no metrics endpoint
+        std::thread exporter;
+        std::atomic<handoff *> lobby = nullptr; // a waiting player without a pair in its reactor
+
+        handoff *takeParked() { // the player of the lobby, nullptr - it is empty
+            handoff *waiting = lobby.exchange(nullptr);
+            if (waiting) {
+                unwatch(waiting);
+            }
+            return waiting;
+        }
+
+        static void unwatch(handoff *moving) { // the reactor that parked the player doesn't see its socket any more
+            if (moving->parkedIn >= 0) {
+                epoll_ctl(moving->parkedIn, EPOLL_CTL_DEL, moving->fd, nullptr);
+                moving->parkedIn = -1;
+            }
+        }
+        std::mutex resumeMutex; // guards suspended and the holders of its games
+        std::unordered_map<std::string, std::shared_ptr<suspendedGame>> suspended; // by the logins of the players
+
+        std::atomic<bool> isActive = true; // Socket state
+
+        size_t boardSize = 3;
+        size_t winLength = 3;
+        std::string restartMessage = "restart"; // carries the board size when it is not classic
+
+        std::chrono::seconds botWait{0}; // waiting time before playing with the bot, 0 - no bot
+        std::chrono::milliseconds botMoveTime{200}; // search time of one bot move
+        size_t botWorkers = 4; // bot moves every reactor searches at once
+        size_t botThreads = 1; // MCTS threads of every bot worker for boards bigger than 8x8
+
+        // deadlines of the connection states, 0 - none
+        std::chrono::seconds turnTime{0}; // a player who doesn't move in time loses the game
+        std::chrono::seconds queueLimit{0}; // waiting without an opponent, the bot may come earlier
+        std::chrono::seconds idleTimeout{0}; // silence of a logged-in client out of games and queues
+        std::chrono::seconds loginTimeout{0}; // from connecting to logging in
+        std::chrono::seconds resumeWait{60}; // for the other player of a game of the last run, 0 - no limit
+
+        std::string checkpointPath = ".sessions"; // files of the reactors start with it, empty - games are not saved
+        std::chrono::seconds checkpointInterval{5}; // 0 - only on shutdown
+        static constexpr std::chrono::minutes RESUMELIMIT{10}; // after the start, the games nobody came back to go
+        clock::time_point resumeUntil;
+
+        // <path>.<id>, in a cluster <path>.<pid>.<id>, as the processes may share the directory
+        [[nodiscard]] std::string checkpointFile(const size_t id) const {
+            const std::string process = cluster ? std::to_string(cluster->pid()) + "." : "";
+            return checkpointPath + "." + process + std::to_string(id);
         }
 
-        void createDescriptor() {
-            if (setsockopt(master_socket,
-                           SOL_SOCKET,
-                           SO_REUSEADDR | SO_REUSEPORT,
-                           &opt,
-                           sizeof(opt)
-            ) < 0) {
-                throw std::invalid_argument("Can't create socket descriptor");
+        // files of the processes of the cluster that are gone, renamed to this one first, so only one process takes
+        // a file; a crash before they are loaded leaves them to the next start
+        std::vector<std::string> claimCheckpoints() const {
+            const size_t slash = checkpointPath.rfind('/');
+            const std::string directory = slash == std::string::npos ? "" : checkpointPath.substr(0, slash + 1);
+            const std::string prefix = checkpointPath.substr(directory.size()) + ".";
+            std::vector<std::string> claimed;
+            DIR *files = opendir(directory.empty() ? "." : directory.c_str());
+            if (!files) {
+                return claimed;
             }
-            logger.log(Logger::INFO, "Create descriptor: OK.");
+            while (const dirent *entry = readdir(files)) {
+                const std::string_view name = entry->d_name;
+                if (!name.starts_with(prefix)) {
+                    continue;
+                }
+                uint32_t pid = 0;
+                const char *end = name.data() + name.size();
+                const auto [next, error] = std::from_chars(name.data() + prefix.size(), end, pid);
+                if (error != std::errc() || next == end || *next != '.' || sharedState::isAlive(pid)) {
+                    continue;
+                }
+                const std::string to = checkpointFile(claimed.size()) + ".taken";
+                if (rename((directory + std::string(name)).c_str(), to.c_str()) == 0) {
+                    claimed.push_back(to);
+                }
+            }
+            closedir(files);
+            return claimed;
         }
 
-        void bindSocket() {
-            if (bind(master_socket,
-                     (struct sockaddr *) &address,
-                     sizeof(address)
-            ) < 0) {
-                throw std::invalid_argument("Can't bind socket");
+        void loadSessions() { // games of the last run, the reactors write their files again
+            std::vector<std::string> paths;
+            if (cluster) {
+                paths = claimCheckpoints();
+            } else {
+                for (size_t id = 0; access(checkpointFile(id).c_str(), F_OK) == 0; ++id) {
+                    paths.push_back(checkpointFile(id));
+                }
+            }
+            size_t games = 0;
+            const auto isUnknown = [this](const std::string &login) { return !login.empty() && !findUser(login); };
+            for (const std::string &path: paths) {
+                for (checkpoint::game &saved: checkpoint::load(path, boardSize, winLength)) {
+                    if (isUnknown(saved.players[0]) || isUnknown(saved.players[1])) { // gone with the database
+                        continue;
+                    }
+                    auto game = std::make_shared<suspendedGame>();
+                    game->saved = std::move(saved);
+                    for (const std::string &login: game->saved.players) {
+                        if (!login.empty()) {
+                            suspended[login] = game;
+                        }
+                    }
+                    ++games;
+                }
+                std::remove(path.c_str());
             }
-            logger.log(Logger::INFO, "Binding: OK.");
+            resumeUntil = clock::now() + RESUMELIMIT;
+            LOGF(logger, INFO, "Games to resume: {}", games);
+        }
+
+        void dropSuspended() { // under resumeMutex, the games with a player waiting stay till its deadline
+            std::erase_if(suspended, [](const auto &entry) { return entry.second->holder < 0; });
         }
 
-        void listenSocket() const {
-            if (listen(master_socket, max_clients + 1) < 0) {
-                throw std::invalid_argument("Listen error");
+        void forget(const checkpoint::game &saved) { // under resumeMutex, the game is resumed or given up
+            for (const std::string &login: saved.players) {
+                if (!login.empty()) {
+                    suspended.erase(login);
+                }
             }
-            logger.log(Logger::INFO, "Listening: OK.");
         }
 
-        void loadDB() {
+        void loadDB() { // snapshot, then the journals in the order of writing
             logger.log(Logger::INFO, "Start loading the database.");
 
-            std::ifstream DBFile(".db");
-
-            if (!DBFile.is_open()) {
+            std::ifstream snapshot(STOREPATH);
+            const bool imported = !snapshot.is_open(); // the first start takes the users from the text .db
+            snapshot.close();
+            db = std::make_unique<userStore>(imported ? "" : STOREPATH);
+
+            auto add = [this](std::string_view login, std::string_view password) {
+                addUser(login, password);
+            };
+            size_t rejected = 0; // accounts of the old .db the store can't keep, nothing is saved when there are any
+            auto import = [&](std::string_view login, std::string_view password) {
+                if (!userStore::fits(login, password)) {
+                    LOGF(logger, ERROR, "Can't import user {}: the login or the password is too long", login);
+                    std::cerr << "Can't import user " << login << ": the login or the password is too long\n";
+                    ++rejected;
+                    return;
+                }
+                addUser(login, password);
+            };
+            if (imported && !userJournal::replay(DBPATH, import)) {
                 throw std::invalid_argument("Can't read database");
             }
+            if (rejected > 0) {
+                throw std::invalid_argument("Users that don't fit the store: " + std::to_string(rejected));
+            }
+            const bool unfinished = userJournal::replay(OLDJOURNALPATH, add); // compaction was interrupted
+            userJournal::replay(JOURNALPATH, add);
+            journal = std::make_unique<userJournal>(JOURNALPATH);
+            if (imported || unfinished) {
+                compact(false);
+            }
+
+            LOGF(logger, INFO, "End loading the database. Users: {}", db->size());
+            std::cout << "Database loaded" << std::endl;
+        }
 
-            std::string currentLine;
-            while (getline(DBFile, currentLine)) {
-                std::string login = currentLine.substr(0, currentLine.find(':'));
-                std::string password = currentLine.substr(login.size() + 1);
-                db.insert(std::make_pair(login, userData(password, false, false)));
+        // under dbMutex, the runtime state is made when the user is met first, so the start doesn't read the table
+        userData &stateOf(const userStore::record &user) {
+            auto [found, isNew] = userStates.try_emplace(user.id);
+            if (isNew) {
+                found->second.id = user.id;
+                if (user.rating) {
+                    found->second.rating = user.rating;
+                }
             }
+            return found->second;
+        }
 
-            DBFile.close();
+        // under dbMutex, returns the runtime state of the new user or nullptr when the login is taken
+        userData *addUser(std::string_view login, std::string_view password) {
+            const userStore::record *added = db->insert(login, password);
+            return added ? &stateOf(*added) : nullptr;
+        }
 
-            logger.log(Logger::INFO, "End loading the database.");
-            std::cout << "Database loaded" << std::endl;
+        // under dbMutex, a user registered by another process of the cluster gets a state here too
+        const userStore::record *findUser(std::string_view login) {
+            const userStore::record *found = db->find(login);
+            if (found || !cluster) {
+                return found;
+            }
+            const uint32_t shared = cluster->find(login);
+            if (shared == sharedState::NONE) {
+                return nullptr;
+            }
+            userData *state = addUser(login, cluster->password(shared)); // the journal of the other process has it
+            if (!state) {
+                return nullptr;
+            }
+            state->shared = shared;
+            return db->find(login);
+        }
+
+        // under dbMutex, nullptr when the login is taken in any process of the cluster or doesn't fit
+        userData *newUser(std::string_view login, std::string_view password) {
+            if (!userStore::fits(login, password) || findUser(login)) {
+                return nullptr;
+            }
+            uint32_t shared = sharedState::NONE;
+            if (cluster) {
+                bool isNew;
+                shared = cluster->publish(login, password, isNew);
+                if (!isNew) { // registered by another process right now or the shared table is full
+                    return nullptr;
+                }
+            }
+            userData *state = addUser(login, password);
+            if (state) {
+                state->shared = shared;
+            }
+            return state;
+        }
+
+        // under dbMutex, the login of the whole cluster, false when the user is logged in another process
+        bool claim(userData &state, std::string_view login, std::string_view password) {
+            if (!cluster) {
+                return true;
+            }
+            if (state.shared == sharedState::NONE) {
+                bool isNew;
+                state.shared = cluster->publish(login, password, isNew);
+            }
+            return state.shared != sharedState::NONE && cluster->logIn(state.shared, state.rating);
+        }
+
+        void logOut(userData &state) { // under dbMutex
+            state.isLogged = false;
+            if (cluster && state.shared != sharedState::NONE) {
+                cluster->logOut(state.shared); // nothing when the user was sent to another process
+            }
+        }
+
+        void keepRating(std::string_view login, const userData &state) { // under dbMutex
+            if (db->setRating(login, state.rating)) { // written by the next compaction
+                ratingsChanged = true;
+            }
+            if (cluster && state.shared != sharedState::NONE) {
+                cluster->setRating(state.shared, state.rating);
+            }
+        }
+
+        // every process of the cluster can log in the users of this one; runs beside the reactors, a chunk of slots
+        // at a time, a user logged in before it is published by claim()
+        void publishUsers() {
+            static const size_t CHUNK = 4096;
+            for (size_t begin = 0, capacity = 0; isActive; begin += CHUNK) {
+                std::lock_guard lock(dbMutex);
+                if (db->getCapacity() != capacity) { // the table grew and the users moved
+                    capacity = db->getCapacity();
+                    begin = 0;
+                }
+                if (begin >= capacity) {
+                    break;
+                }
+                db->forEach(begin, std::min(begin + CHUNK, capacity), [this](const userStore::record &user) {
+                    bool isNew;
+                    cluster->publish(user.getLogin(), user.getPassword(), isNew);
+                });
+            }
+            LOGF(logger, INFO, "Users of process {} are published", cluster->pid());
         }
 
-        void saveDB() {
-            logger.log(Logger::INFO, "Start saving the database.");
+        // the lonely player goes to another process that has one, false - there is none
+        bool transfer(handoff *moving) {
+            if (!cluster || moving->user->shared == sharedState::NONE) {
+                return false;
+            }
+            const uint32_t shared = moving->user->shared;
+            const playerChannel::parcel parcel{moving->fd, std::string(cluster->login(shared)), moving->unread,
+                                               moving->unsent, moving->queuedAt.time_since_epoch().count(),
+                                               moving->binary};
+            for (uint32_t pid; (pid = cluster->takeTicket()) != 0;) {
+                if (!cluster->moveOwner(shared, cluster->pid(), pid)) {
+                    return false;
+                }
+                if (channel->send(pid, parcel)) {
+                    LOGF(logger, INFO, "Send {} to the process {}", parcel.login, pid);
+                    close(moving->fd);
+                    {
+                        std::lock_guard lock(dbMutex);
+                        logOut(*moving->user);
+                    }
+                    delete moving;
+                    return true;
+                }
+                cluster->moveOwner(shared, pid, cluster->pid()); // the process is gone or full
+            }
+            return false;
+        }
 
-            std::fstream DBFile(".db", std::ios::out | std::ios::trunc);
+        // the state of a player sent by another process, it is logged in here already; nullptr - unknown user
+        userData *welcome(std::string_view login) {
+            std::lock_guard lock(dbMutex);
+            const userStore::record *found = findUser(login);
+            if (!found) {
+                if (const uint32_t shared = cluster->find(login); shared != sharedState::NONE) {
+                    cluster->logOut(shared);
+                }
+                return nullptr;
+            }
+            userData &state = userStates[found->id];
+            if (state.shared == sharedState::NONE) {
+                state.shared = cluster->find(login);
+            }
+            if (state.shared != sharedState::NONE && cluster->rating(state.shared) != 0) {
+                state.rating = cluster->rating(state.shared);
+            }
+            state.isLogged = true;
+            return &state;
+        }
 
-            if (!DBFile.is_open()) {
-                throw std::invalid_argument("Can't save database");
+        // under dbMutex, a user published or rated by another process goes into the table of this one
+        void takeShared(const uint32_t shared) {
+            if (findUser(cluster->login(shared)) && cluster->rating(shared) != 0) {
+                db->setRating(cluster->login(shared), cluster->rating(shared));
             }
+        }
 
-            for (auto const &[login, data]: db) {
-                DBFile << login << ':' << data.password << std::endl;
+        // writes the users changed since the last snapshot into it, the journal records in it are dropped
+        void compact(const bool rotate = true) {
+            logger.log(Logger::INFO, "Start compacting the database.");
+
+            userStore::changes changes;
+            size_t users;
+            {
+                std::lock_guard lock(dbMutex); // registrations append to the journal under this lock
+                // the snapshot of every process keeps the users and ratings of the whole cluster
+                if (cluster && !cluster->forEachChange(changeCursor, [this](uint32_t shared) { takeShared(shared); })) {
+                    logger.log(Logger::WARNING, "Changes of the cluster were missed, reading every shared user.");
+                    cluster->forEach([this](uint32_t shared) { takeShared(shared); });
+                }
+                ratingsChanged = false;
+                changes = db->takeChanges();
+                users = db->size();
+                if (rotate) {
+                    journal->rotate(OLDJOURNALPATH);
+                }
             }
+            try {
+                userStore::save(STOREPATH, changes);
+            } catch (const std::exception &) {
+                std::lock_guard lock(dbMutex);
+                db->forgetSaved();
+                throw;
+            }
+            std::remove(OLDJOURNALPATH);
+
+            LOGF(logger, INFO, "End compacting the database. Users: {}, written: {}", users,
+                 changes.image.empty() ? changes.records.size() : users);
+        }
 
-            DBFile.close();
+        [[nodiscard]] bool isClusterChanged() {
+            std::lock_guard lock(dbMutex);
+            return cluster && cluster->changeCount() != changeCursor;
+        }
 
-            logger.log(Logger::INFO, "End saving the database.");
+        void compactLoop() {
+            std::unique_lock lock(compactMutex);
+            while (!compactSignal.wait_for(lock, compactInterval, [this] { return !isActive; })) {
+                if (journal->size() == 0 && !ratingsChanged && !isClusterChanged()) {
+                    continue;
+                }
+                lock.unlock();
+                try {
+                    compact();
+                } catch (const std::exception &e) {
+                    logger.log(Logger::ERROR, e.what());
+                }
+                lock.lock();
+            }
         }
 
         void readCfg() {
@@ -162,264 +1839,247 @@ namespace TicTacToeServer {
 
         void setupCfg() {
             logger.log(Logger::INFO, "Start setup cfg.");
-            gameSessions.resize(std::stoul(configData["GAMESESSIONS"]));
-            isSessionUsed.resize(std::stoul(configData["GAMESESSIONS"]));
+            if (configData.contains("BOARDSIZE")) {
+                boardSize = std::stoul(configData["BOARDSIZE"]);
+            }
+            winLength = configData.contains("WINLENGTH") ? std::stoul(configData["WINLENGTH"]) : boardSize;
+            if (boardSize != 3 || winLength != 3) {
+                restartMessage += " " + std::to_string(boardSize) + " " + std::to_string(winLength);
+            }
+            if (configData.contains("COMPACTINTERVAL")) {
+                compactInterval = std::chrono::seconds(std::stoul(configData["COMPACTINTERVAL"]));
+            }
+            if (configData.contains("BOTWAIT")) {
+                botWait = std::chrono::seconds(std::stoul(configData["BOTWAIT"]));
+            }
+            if (configData.contains("BOTMOVETIME")) {
+                botMoveTime = std::chrono::milliseconds(std::stoul(configData["BOTMOVETIME"]));
+            }
+            if (configData.contains("BOTWORKERS")) {
+                botWorkers = std::stoul(configData["BOTWORKERS"]);
+            }
+            if (configData.contains("BOTTHREADS")) {
+                botThreads = std::stoul(configData["BOTTHREADS"]);
+            }
+            if (configData.contains("TURNTIME")) { // seconds, as the rest of the deadlines
+                turnTime = std::chrono::seconds(std::stoul(configData["TURNTIME"]));
+            }
+            if (configData.contains("QUEUELIMIT")) {
+                queueLimit = std::chrono::seconds(std::stoul(configData["QUEUELIMIT"]));
+            }
+            if (configData.contains("IDLETIMEOUT")) {
+                idleTimeout = std::chrono::seconds(std::stoul(configData["IDLETIMEOUT"]));
+            }
+            if (configData.contains("LOGINTIMEOUT")) {
+                loginTimeout = std::chrono::seconds(std::stoul(configData["LOGINTIMEOUT"]));
+            }
+            if (configData.contains("RESUMEWAIT")) {
+                resumeWait = std::chrono::seconds(std::stoul(configData["RESUMEWAIT"]));
+            }
+            if (configData.contains("CHECKPOINT")) { // an empty value turns the checkpoints off
+                checkpointPath = configData["CHECKPOINT"];
+            }
+            if (configData.contains("CHECKPOINTINTERVAL")) {
+                checkpointInterval = std::chrono::seconds(std::stoul(configData["CHECKPOINTINTERVAL"]));
+            }
+            if (configData["LOGOVERFLOW"] == "drop") { // never block reactors on a slow disk
+                logger.setOverflowPolicy(Logger::DROP);
+            }
+            if (configData.contains("LOGLEVEL")) { // debug, info, warning or error
+                const std::string &level = configData["LOGLEVEL"];
+                logger.setLevel(level == "info" ? Logger::INFO : level == "warning" ? Logger::WARNING :
+                                level == "error" ? Logger::ERROR : Logger::DEBUG);
+            }
+            if (configData.contains("OUTPUTLIMIT")) { // bytes
+                outputLimit = std::stoul(configData["OUTPUTLIMIT"]);
+            }
+            if (configData.contains("SPECTATORLIMIT")) { // bytes
+                spectatorLimit = std::stoul(configData["SPECTATORLIMIT"]);
+            }
+            if (const std::string path = configData.contains("ARCHIVE") ? configData["ARCHIVE"] : "games.archive";
+                    !path.empty()) { // an empty value turns the archive off
+                games = std::make_unique<archive::writer>(path);
+            }
+            if (configData.contains("CLUSTER") && !configData["CLUSTER"].empty()) { // processes of one port and host
+                const size_t users = configData.contains("CLUSTERUSERS") ? std::stoul(configData["CLUSTERUSERS"])
+                                                                         : 1 << 17;
+                cluster = std::make_unique<sharedState>(configData["CLUSTER"], users);
+                channel = std::make_unique<playerChannel>(configData["CLUSTER"], cluster->pid());
+                publisher = std::thread(&serverSocket::publishUsers, this);
+                LOGF(logger, INFO, "Process {} in cluster {}", cluster->pid(), configData["CLUSTER"]);
+            }
+            if (configData.contains("METRICSPORT")) { // Prometheus endpoint on the local interface
+                metricsPort = static_cast<uint16_t>(std::stoul(configData["METRICSPORT"]));
+            }
+            if (configData["LOGFORMAT"] == "binary") { // the text is made later by logdecode
+                logger.setBinary("server.log.bin");
+            }
+
+            size_t threads = configData.contains("THREADS") ? std::stoul(configData["THREADS"]) : 0;
+            if (threads == 0) {
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            }
+
+            if (!checkpointPath.empty()) {
+                loadSessions();
+            }
 
-            max_clients = std::stoi(configData["MAXCLIENTS"]);
-            client_sockets.resize(max_clients);
+            // clients and sessions are split between the reactors
+            size_t clients = std::stoul(configData["MAXCLIENTS"]);
+            // sessions reserved on start, the pools grow when more games are played
+            size_t sessions = configData.contains("GAMESESSIONS") ? std::stoul(configData["GAMESESSIONS"]) : 0;
+            for (size_t id = 0; id < threads; ++id) {
+                reactors.push_back(std::make_unique<reactor>(*this, id,
+                                                             static_cast<int>((clients + threads - 1) / threads),
+                                                             (sessions + threads - 1) / threads));
+            }
 
             std::cout << "Config loaded" << std::endl;
-            logger.log(Logger::INFO, "End setup cfg.");
+            LOGF(logger, INFO, "End setup cfg. Reactors: {}", threads);
         }
 
         void inputThread() {
             std::string command;
             while (true) {
                 std::cin >> command;
-                logger.log(Logger::INFO, "Entered a command: " + command);
+                LOGF(logger, INFO, "Entered a command: {}", command);
                 if (command == "exit") {
-                    this->isActive = false;
+                    stop();
                     break;
                 } else if (command == "queue") {
-                    std::cout << waitingQueue.size() << std::endl;
-                    for (const auto &el: waitingQueue) {
-                        std::cout << el << ' ';
+                    for (size_t id = 0; id < reactors.size(); ++id) {
+                        std::cout << "reactor " << id << ": " << reactors[id]->queueSize << std::endl;
                     }
-                    std::cout << std::endl;
+                    std::cout << "lobby: " << (lobby ? 1 : 0) << std::endl;
                 } else if (command == "db") {
-                    for (const auto &[login, data]: db) {
-                        const auto &[password, isLogged, isPlaying, activeSession] = data;
-                        std::cout << login << ' ' << password << ' ' << isLogged << ' ' << isPlaying << ' '
-                                  << activeSession
-                                  << ' ' << isSessionUsed[activeSession] << std::endl;
-                    }
+                    std::lock_guard lock(dbMutex);
+                    db->forEach([this](const userStore::record &user) {
+                        userData state; // users not met since the start have no state, the saved rating is theirs
+                        if (const auto found = userStates.find(user.id); found != userStates.end()) {
+                            state = found->second;
+                        } else if (user.rating) {
+                            state.rating = user.rating;
+                        }
+                        std::cout << user.getLogin() << ' ' << user.getPassword() << ' ' << state.isLogged << ' '
+                                  << state.isPlaying << ' ' << state.rating << std::endl;
+                    });
                 } else {
                     std::cout << "Unknown command." << std::endl;
                 }
             }
         }
 
-        void runInputThread() {
-            std::thread th(&serverSocket::inputThread, this);
-            th.detach();
+        std::string renderMetrics() {
+            uint64_t connections = 0, logins = 0, registrations = 0, matches = 0, botMatches = 0;
+            int64_t connected = 0, sessionsInUse = 0, queued = 0;
+            auto queueWait = std::make_unique<histogram>(), putLatency = std::make_unique<histogram>();
+            for (auto &r: reactors) {
+                connections += r->stats.connections.get();
+                logins += r->stats.logins.get();
+                registrations += r->stats.registrations.get();
+                matches += r->stats.matches.get();
+                botMatches += r->stats.botMatches.get();
+                connected += r->stats.connected.get();
+                sessionsInUse += r->stats.sessionsInUse.get();
+                queued += static_cast<int64_t>(r->queueSize.load());
+                queueWait->merge(r->stats.queueWait);
+                putLatency->merge(r->stats.putLatency);
+            }
+            std::string out;
+            prometheus::writeCounter(out, "tictactoe_connections_total", "Accepted connections.", connections);
+            prometheus::writeGauge(out, "tictactoe_connections", "Connected clients.", connected);
+            prometheus::writeCounter(out, "tictactoe_logins_total", "Successful logins.", logins);
+            prometheus::writeCounter(out, "tictactoe_registrations_total", "Successful registrations.",
+                                     registrations);
+            prometheus::writeGauge(out, "tictactoe_queue_depth", "Players waiting for a game.",
+                                   queued + (lobby ? 1 : 0));
+            prometheus::writeGauge(out, "tictactoe_sessions_in_use", "Games being played.", sessionsInUse);
+            prometheus::writeCounter(out, "tictactoe_matches_total", "Games of two players started.", matches);
+            prometheus::writeCounter(out, "tictactoe_bot_matches_total", "Games with the bot started.", botMatches);
+            prometheus::writeSummary(out, "tictactoe_queue_wait_seconds", "Time from queueing to the game.",
+                                     *queueWait, 1e-9);
+            prometheus::writeSummary(out, "tictactoe_put_seconds", "Time of handling a move request.",
+                                     *putLatency, 1e-9);
+            return out;
         }
 
-        void createSession() {
-            for (int i = 0; i < std::stoul(configData["GAMESESSIONS"]); ++i) {
-                if (!isSessionUsed[i]) { // looking for free gameSession
-                    isSessionUsed[i] = true;
-                    logger.log(Logger::DEBUG, "Session " + std::to_string(i) + " in use.");
-                    int firstClient = waitingQueue.front();
-                    waitingQueue.pop_front();
-                    int secondClient = waitingQueue.front();
-                    waitingQueue.pop_front();
-
-                    // add to the database as players
-                    db[clientLogin[firstClient]].isPlaying = true;
-                    db[clientLogin[firstClient]].activeSession = i;
-                    db[clientLogin[secondClient]].isPlaying = true;
-                    db[clientLogin[secondClient]].activeSession = i;
-
-                    gameSessions[i].restart();
-                    std::this_thread::sleep_for(
-                            std::chrono::milliseconds(500)); // to prevent double message send
-
-                    for (const auto client: {firstClient, secondClient}) {
-                        logger.log(Logger::DEBUG, "Pop " + std::to_string(client) + " from queue");
-                        gameSessions[i].addUser(client);
-                        sendMessage(client, "restart");
-                    }
-                    std::this_thread::sleep_for(std::chrono::milliseconds(500)); // prevent double message
-                    sendMessage(rng() % 2 == 0 ? firstClient : secondClient, "lock");
-
-                    break;
+        // answers every connection with the metrics, a scrape is rare and small, so one blocking thread is enough
+        void exportLoop() try {
+            int exporter_socket = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            int opt = 1;
+            setsockopt(exporter_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+            sockaddr_in local{AF_INET, htons(metricsPort), {htonl(INADDR_LOOPBACK)}, {}};
+            if (exporter_socket < 0 || bind(exporter_socket, (struct sockaddr *) &local, sizeof(local)) < 0 ||
+                listen(exporter_socket, 16) < 0) {
+                close(exporter_socket);
+                throw std::invalid_argument("Can't open metrics port");
+            }
+            LOGF(logger, INFO, "Metrics on port {}", metricsPort);
+            while (isActive) {
+                pollfd listening{exporter_socket, POLLIN, 0};
+                if (poll(&listening, 1, 500) <= 0) { // check the state every 500ms
+                    continue;
+                }
+                int scraper = accept(exporter_socket, nullptr, nullptr);
+                if (scraper < 0) {
+                    continue;
                 }
+                pollfd request{scraper, POLLIN, 0};
+                char buffer[1024];
+                if (poll(&request, 1, 1000) > 0) { // the request itself doesn't matter, only /metrics is served
+                    recv(scraper, buffer, sizeof(buffer), MSG_DONTWAIT);
+                }
+                const std::string body = renderMetrics();
+                const std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                             "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+                send(scraper, response.data(), response.size(), MSG_NOSIGNAL);
+                close(scraper);
+            }
+            close(exporter_socket);
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            logger.log(Logger::ERROR, e.what());
+        }
+
+        void stop() { // reactors sleep until their deadlines, so they are woken to see the state
+            isActive = false;
+            for (auto &r: reactors) {
+                r->wake();
             }
         }
 
+        void runInputThread() {
+            std::thread th(&serverSocket::inputThread, this);
+            th.detach();
+        }
+
     public:
-        serverSocket() try:
-                addrLen(sizeof(address)) {
+        serverSocket() try {
 
             logger.log(Logger::INFO, "starting loading cfg.");
 
             readCfg();
 
-            setupCfg();
-
             loadDB();
 
-            address = {AF_INET, htons(std::stoul(configData["PORT"])), {inet_addr(configData["HOST"].c_str())}};
+            setupCfg();
 
             runInputThread(); // async thread for console commands
 
-            createMasterSocket();
-
-            createDescriptor();
-
-            bindSocket();
-
-            listenSocket();
+            if (compactInterval.count() > 0) {
+                compactor = std::thread(&serverSocket::compactLoop, this);
+            }
+            if (metricsPort != 0) {
+                exporter = std::thread(&serverSocket::exportLoop, this);
+            }
 
             std::cout << "Waiting for connections..." << std::endl;
 
-            while (this->isActive) { // Socket Loop
-                FD_ZERO(&readfds);
-
-                FD_SET(master_socket, &readfds);
-                max_sd = master_socket;
-
-                for (int i = 0; i < max_clients; ++i) { // idk
-                    int sd = client_sockets[i];
-                    if (sd > 0) {
-                        FD_SET(sd, &readfds);
-                    }
-                    if (sd > max_sd) {
-                        max_sd = sd;
-                    }
-                }
-
-                // select with unlock after 500ms ( look &tv )
-                activity = select(max_sd + 1, &readfds, &writefds, nullptr, &tv);
-                if (activity < 0 && errno != EINTR) {
-                    throw std::invalid_argument("Select error");
-                }
-
-                if (FD_ISSET(master_socket, &readfds)) { // new connections
-                    if ((new_socket = accept(
-                            master_socket,
-                            (struct sockaddr *) &address,
-                            (socklen_t *) &addrLen)) < 0) {
-                        throw std::invalid_argument("Accept error");
-                    }
-
-                    std::cout << "New connection, socket fd: " << new_socket <<
-                              " ip: " << inet_ntoa(address.sin_addr) <<
-                              " port: " << ntohs(address.sin_port) << std::endl;
-                    logger.log(Logger::DEBUG, "User " + std::to_string(new_socket) + " is connected. IP: " +
-                                              inet_ntoa(address.sin_addr) + ", Port: " +
-                                              std::to_string(ntohs(address.sin_port)));
-
-                    for (int i = 0; i < max_clients; ++i) {
-                        if (client_sockets[i] == 0) {
-                            client_sockets[i] = new_socket;
-                            std::cout << "Adding to list of sockets as " << i << std::endl;
-                            logger.log(Logger::DEBUG, "Adding to list as " + std::to_string(i));
-                            break;
-                        }
-                    }
-                }
-
-                if (waitingQueue.size() >= 2) { // Start gameSession when 2 clients are waiting for the game
-                    createSession();
-                }
-
-                for (int i = 0; i < max_clients; ++i) { // Main request handler
-                    int sd = client_sockets[i];
-                    if (FD_ISSET(sd, &readfds)) {
-                        memset(buffer, 0, BUFFERSIZE);
-                        if ((valread = read(sd, buffer, BUFFERSIZE)) == 0) { // if client disconnect
-                            getpeername(sd,
-                                        (struct sockaddr *) &address,
-                                        (socklen_t *) &addrLen);
-                            std::cout << "Host disconnected, ip: " << inet_ntoa(address.sin_addr) << " port: "
-                                      << ntohs(address.sin_port) << std::endl;
-                            logger.log(Logger::DEBUG, "User " + std::to_string(i) + " is disconnected. IP: " +
-                                                      inet_ntoa(address.sin_addr) + ", Port: " +
-                                                      std::to_string(ntohs(address.sin_port)));
-                            close(sd);
-                            client_sockets[i] = 0;
-                            if (clientLogin.contains(i)) { // free in [idx -> login] map
-                                auto &[password, isLogged, isPlaying, activeSession] = db[clientLogin[i]];
-
-                                for (int j = 0;
-                                     j < max_clients; ++j) { // send other clients a message about disconnection
-                                    if (clientLogin.contains(j) && db[clientLogin[j]].isPlaying &&
-                                        db[clientLogin[j]].activeSession == activeSession) {
-                                        sendMessage(j, "disconnect");
-                                        db[clientLogin[j]].isPlaying = false;
-                                    }
-                                }
-
-                                isLogged = false;
-                                clientLogin.erase(clientLogin.find(i));
-                                isSessionUsed[activeSession] = false;
-                            }
-                            if (auto it = std::find_if(waitingQueue.begin(), waitingQueue.end(),
-                                                       [i](int current) { // delete from waiting queue
-                                                           return current == i;
-                                                       }); it != std::end(waitingQueue)) {
-                                waitingQueue.erase(it);
-                                logger.log(Logger::DEBUG, "Pop " + std::to_string(*it) + " from queue");
-                            }
-                        } else { // if got a message
-                            std::cout << "msg from client: " << buffer << std::endl;
-                            logger.log(Logger::DEBUG,
-                                       "Got message: " + std::string(buffer) + " from " + std::to_string(i));
-                            std::string command = strtok(buffer, " ");
-
-                            if (command == "log") { // login
-                                std::string login = strtok(nullptr, " ");
-                                std::string password = strtok(nullptr, " ");
-
-                                if (!db.contains(login)) { // no login in db
-                                    sendMessage(i, "404");
-                                    continue;
-                                }
-                                if (db[login].password != password) { // wrong password
-                                    sendMessage(i, "401");
-                                    continue;
-                                }
-                                if (db[login].isLogged) { // already logged
-                                    sendMessage(i, "405");
-                                    continue;
-                                }
-                                sendMessage(i, "200"); // good login
-                                clientLogin.insert(std::make_pair(i, login));
-                                db[login].isLogged = true;
-                                waitingQueue.push_back(i);
-                                logger.log(Logger::INFO, "Pushing " + std::to_string(i) + " to queue");
-                            } else if (command == "reg") { // registration
-                                std::string login = strtok(nullptr, " ");
-                                std::string password = strtok(nullptr, " ");
-
-                                if (db.contains(login)) { // already registered
-                                    sendMessage(i, "400");
-                                    continue;
-                                }
-
-                                db.insert(std::make_pair(login, userData(password, false, false)));
-                                sendMessage(i, "200"); // good registration
-                            } else if (command == "put") { // inGame requests
-                                size_t activeSession = db[clientLogin[i]].activeSession;
-
-                                std::vector<int> usersInSession = gameSessions[activeSession].getUsers();
-
-                                std::string id = strtok(nullptr, " ");
-
-                                for (auto user: usersInSession) {
-                                    sendMessage(user, (gameSessions[activeSession].getTurn() ? "X" : "O") +
-                                                      id); // send a move to all users in the session
-                                }
-
-                                gameSessions[activeSession].setCell(stoull(id)); // setCell in local session
-                                if (bool isWon = gameSessions[activeSession].isWon(), isDraw = gameSessions[activeSession].isDraw();
-                                        isWon || isDraw) { // if somebody win or draw
-                                    std::this_thread::sleep_for(
-                                            std::chrono::milliseconds(500)); // prevent double message
-                                    for (auto user: usersInSession) {
-                                        sendMessage(user, isWon ? "win" : "draw");
-                                        db[clientLogin[user]].isPlaying = false;
-                                    }
-                                    isSessionUsed[activeSession] = false;
-                                    logger.log(Logger::DEBUG, "Session " + std::to_string(activeSession) + " is free.");
-                                }
-                            } else if (command == "again") {
-                                waitingQueue.push_back(i);
-                            }
-                        }
-                    }
-                }
+            for (auto &r: reactors) {
+                r->start();
+            }
+            for (auto &r: reactors) {
+                r->join();
             }
         } catch (const std::exception &e) {
             std::cerr << e.what();
@@ -427,23 +2087,34 @@ namespace TicTacToeServer {
         }
 
         ~serverSocket() {
-            saveDB();
+            isActive = false;
+            {
+                std::lock_guard lock(compactMutex);
+            }
+            compactSignal.notify_all();
+            if (compactor.joinable()) {
+                compactor.join();
+            }
+            if (exporter.joinable()) { // reads the reactors
+                exporter.join();
+            }
+            if (publisher.joinable()) {
+                publisher.join();
+            }
 
-            for (int i = 0; i < max_clients; ++i) {
-                send(client_sockets[i], "shutdown", strlen("shutdown"), 0);
-                close(client_sockets[i]);
+            reactors.clear();
+            if (handoff *waiting = lobby.exchange(nullptr)) {
+                protocol::smallFrame binary(protocol::SHUTDOWN);
+                std::string frame = protocol::encodeFrame("shutdown");
+                protocol::outputQueue rest; // answers it didn't get yet go first
+                rest.append(waiting->unsent);
+                rest.append(waiting->binary ? binary.view() : std::string_view(frame));
+                rest.flush(waiting->fd);
+                close(waiting->fd);
+                delete waiting;
             }
-            logger.log(Logger::INFO, "All clients disconnected.");
-            // closing the listening socket
-            shutdown(master_socket, SHUT_RDWR);
-            close(master_socket);
             logger.log(Logger::INFO, "Shutdown.");
         }
-
-        void sendMessage(const int idx, const std::string &message) {
-            send(client_sockets[idx], message.c_str(), strlen(message.c_str()), 0);
-            logger.log(Logger::DEBUG, "Send " + message + " to " + std::to_string(idx));
-        }
     };
 }
 
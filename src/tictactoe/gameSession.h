@@ -9,6 +9,8 @@ class gameSession : public TicTacToe{
 private:
     std::vector<int> users;
 public:
+    explicit gameSession(size_t cells = 3, size_t winLength = 0) : TicTacToe(cells, winLength) {}
+
     void restart(){
         clear();
         users.clear();
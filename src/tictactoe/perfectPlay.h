@@ -0,0 +1,107 @@
+#ifndef PERFECTPLAY_H
+#define PERFECTPLAY_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "tictactoe.h"
+
+// Every position of the classic 3x3 board solved at compile time.
+// A position is the side to move and a base-3 number of the cells: 0 - free, 1 - 'O', 2 - 'X'.
+namespace perfectPlay {
+    static const size_t CELLS = 9;
+    static const size_t CODES = 19683; // 3^9
+    static const uint8_t NOMOVE = CELLS;
+
+    struct entry {
+        int8_t score; // > 0 - side to move wins, < 0 - loses, 0 - draw; faster wins have bigger scores
+        uint8_t move; // best cell or NOMOVE when the game is over
+    };
+
+    namespace detail {
+        constexpr std::array<uint16_t, 8> LINES{0007, 0070, 0700, 0111, 0222, 0444, 0421, 0124}; // cell masks
+
+        constexpr std::array<size_t, CELLS> POW3{1, 3, 9, 27, 81, 243, 729, 2187, 6561};
+
+        constexpr bool hasLine(uint16_t mask) {
+            for (const uint16_t line: LINES) {
+                if ((mask & line) == line) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // a move only adds to the code, so solving from the biggest code down finds every child ready
+        constexpr std::array<entry, 2 * CODES> solve() {
+            std::array<entry, 2 * CODES> table{};
+            for (size_t code = CODES; code-- > 0;) {
+                uint16_t masks[2] = {0, 0}; // 'O', 'X'
+                int counts[2] = {0, 0};
+                for (size_t cell = 0, rest = code; cell < CELLS; ++cell, rest /= 3) {
+                    if (rest % 3 != 0) {
+                        masks[rest % 3 - 1] |= 1 << cell;
+                        ++counts[rest % 3 - 1];
+                    }
+                }
+                const bool lines[2] = {hasLine(masks[0]), hasLine(masks[1])};
+                const int stones = counts[0] + counts[1];
+                for (size_t turn = 0; turn < 2; ++turn) {
+                    entry &current = table[turn * CODES + code];
+                    // the side to move never has more stones, both players can start the game
+                    if (counts[turn] > counts[1 - turn] || counts[1 - turn] > counts[turn] + 1 || lines[turn]) {
+                        current = {0, NOMOVE}; // unreachable
+                        continue;
+                    }
+                    if (lines[1 - turn]) {
+                        current = {static_cast<int8_t>(stones - static_cast<int>(CELLS) - 1), NOMOVE};
+                        continue;
+                    }
+                    if (stones == CELLS) { // draw
+                        current = {0, NOMOVE};
+                        continue;
+                    }
+                    current = {INT8_MIN, NOMOVE};
+                    const uint16_t taken = masks[0] | masks[1];
+                    for (size_t cell = 0; cell < CELLS; ++cell) {
+                        if (taken & (1 << cell)) {
+                            continue;
+                        }
+                        const int score = -table[(1 - turn) * CODES + code + (turn + 1) * POW3[cell]].score;
+                        if (score > current.score) {
+                            current = {static_cast<int8_t>(score), static_cast<uint8_t>(cell)};
+                        }
+                    }
+                }
+            }
+            return table;
+        }
+    }
+
+    inline constexpr std::array<entry, 2 * CODES> TABLE = detail::solve();
+
+    inline bool covers(const TicTacToe &board) {
+        return board.getCells() == 3 && board.getWinLength() == 3;
+    }
+
+    inline const entry &lookup(const TicTacToe &board) {
+        size_t code = 0;
+        for (size_t cell = 0; cell < CELLS; ++cell) {
+            code += (board.isOwnedBy(false, cell) + 2 * board.isOwnedBy(true, cell)) * detail::POW3[cell];
+        }
+        return TABLE[board.getTurn() * CODES + code];
+    }
+
+    // 1 - side to move wins with perfect play, -1 - loses, 0 - draw
+    inline int value(const TicTacToe &board) {
+        const int8_t score = lookup(board).score;
+        return (score > 0) - (score < 0);
+    }
+
+    inline size_t bestMove(const TicTacToe &board) {
+        return lookup(board).move;
+    }
+}
+
+#endif
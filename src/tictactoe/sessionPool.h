@@ -0,0 +1,235 @@
+#ifndef SESSIONPOOL_H
+#define SESSIONPOOL_H
+
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "tictactoe.h"
+
+// Game sessions of one board size as a struct of arrays, every field of all sessions lies contiguously.
+// Free sessions are kept in a stack, so acquire() and release() are O(1), and the pool grows when the stack is empty.
+// A 3x3 session takes about 76 bytes, spectator lists are kept only for the sessions being watched.
+class sessionPool {
+public:
+    static constexpr int NOUSER = INT_MIN; // empty player slot
+    static constexpr int8_t NOBOT = -1;
+    static constexpr uint32_t NOAUDIENCE = UINT32_MAX;
+
+private:
+    TicTacToe rules; // board size and line masks shared by every session
+    size_t words; // 64-bit words of one player's bitset
+
+    std::vector<uint64_t> boards; // 2 * words per session: 'O', then 'X'
+    std::vector<uint32_t> moveCount;
+    std::vector<uint32_t> lastMove;
+    std::vector<uint16_t> history; // cells in the order of play, a field of them per session
+    std::vector<uint8_t> turn; // keeps the value of the previous game, like TicTacToe::clear()
+    std::vector<int8_t> botSide; // getTurn() value when the bot moves, NOBOT for two players
+    std::vector<std::array<int, 2>> players;
+    std::vector<uint64_t> startedAt; // ms since the epoch, for the archive
+    std::vector<int> firstMover; // the user of the first move, NOUSER before it
+    std::vector<uint32_t> generation; // changes on every acquire, so late results of old games are noticed
+    std::vector<uint8_t> used;
+    std::vector<uint32_t> audience; // index into spectators, NOAUDIENCE when nobody watches
+
+    std::vector<std::vector<int>> spectators; // one list per watched session
+    std::vector<uint32_t> freeAudiences;
+    std::vector<uint32_t> freeList; // lowest index on the top
+    size_t inUse = 0;
+
+    void grow() {
+        const size_t oldSize = used.size();
+        const size_t newSize = std::max<size_t>(16, 2 * oldSize);
+        boards.resize(2 * words * newSize);
+        moveCount.resize(newSize);
+        lastMove.resize(newSize);
+        history.resize(rules.getFieldSize() * newSize);
+        turn.resize(newSize);
+        botSide.resize(newSize, NOBOT);
+        players.resize(newSize, {NOUSER, NOUSER});
+        startedAt.resize(newSize);
+        firstMover.resize(newSize, NOUSER);
+        generation.resize(newSize);
+        used.resize(newSize);
+        audience.resize(newSize, NOAUDIENCE);
+        for (size_t i = newSize; i-- > oldSize;) {
+            freeList.push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+    [[nodiscard]] const uint64_t *board(size_t session, bool player) const {
+        return boards.data() + (2 * session + player) * words;
+    }
+
+public:
+    explicit sessionPool(size_t cells = 3, size_t winLength = 0, size_t reserved = 0) :
+            rules(cells, winLength), words(rules.getWords()) {
+        while (used.size() < reserved) {
+            grow();
+        }
+    }
+
+    size_t acquire() {
+        if (freeList.empty()) {
+            grow();
+        }
+        const size_t session = freeList.back();
+        freeList.pop_back();
+        std::fill_n(boards.begin() + static_cast<ptrdiff_t>(2 * words * session), 2 * words, 0);
+        moveCount[session] = 0;
+        botSide[session] = NOBOT;
+        players[session] = {NOUSER, NOUSER};
+        startedAt[session] = 0;
+        firstMover[session] = NOUSER;
+        ++generation[session];
+        used[session] = true;
+        ++inUse;
+        return session;
+    }
+
+    void release(size_t session) {
+        if (!used[session]) {
+            return;
+        }
+        used[session] = false;
+        if (audience[session] != NOAUDIENCE) {
+            spectators[audience[session]].clear();
+            freeAudiences.push_back(audience[session]);
+            audience[session] = NOAUDIENCE;
+        }
+        freeList.push_back(static_cast<uint32_t>(session));
+        --inUse;
+    }
+
+    [[nodiscard]] bool isUsed(size_t session) const {
+        return used[session];
+    }
+
+    [[nodiscard]] uint32_t getGeneration(size_t session) const {
+        return generation[session];
+    }
+
+    void addUser(size_t session, int user) {
+        players[session][players[session][0] != NOUSER] = user;
+    }
+
+    [[nodiscard]] const std::array<int, 2> &getUsers(size_t session) const {
+        return players[session];
+    }
+
+    [[nodiscard]] uint64_t getStartedAt(size_t session) const {
+        return startedAt[session];
+    }
+
+    void setStartedAt(size_t session, uint64_t milliseconds) {
+        startedAt[session] = milliseconds;
+    }
+
+    [[nodiscard]] int getFirstMover(size_t session) const {
+        return firstMover[session];
+    }
+
+    void setFirstMover(size_t session, int user) {
+        firstMover[session] = user;
+    }
+
+    void addSpectator(size_t session, int spectator) {
+        if (audience[session] == NOAUDIENCE) {
+            if (freeAudiences.empty()) {
+                freeAudiences.push_back(static_cast<uint32_t>(spectators.size()));
+                spectators.emplace_back();
+            }
+            audience[session] = freeAudiences.back();
+            freeAudiences.pop_back();
+        }
+        spectators[audience[session]].push_back(spectator);
+    }
+
+    void removeSpectator(size_t session, int spectator) { // the order of spectators isn't kept
+        std::vector<int> &list = spectators[audience[session]];
+        *std::find(list.begin(), list.end(), spectator) = list.back();
+        list.pop_back();
+        if (list.empty()) {
+            freeAudiences.push_back(audience[session]);
+            audience[session] = NOAUDIENCE;
+        }
+    }
+
+    [[nodiscard]] std::span<const int> getSpectators(size_t session) const {
+        if (audience[session] == NOAUDIENCE) {
+            return {};
+        }
+        return spectators[audience[session]];
+    }
+
+    [[nodiscard]] int8_t getBotSide(size_t session) const {
+        return botSide[session];
+    }
+
+    void setBotSide(size_t session, int8_t side) {
+        botSide[session] = side;
+    }
+
+    [[nodiscard]] bool isFree(size_t session, size_t cellID) const {
+        return cellID < rules.getFieldSize() &&
+               !(((board(session, false)[cellID >> 6] | board(session, true)[cellID >> 6]) >> (cellID & 63)) & 1);
+    }
+
+    [[nodiscard]] char getCell(size_t session, size_t cellID) const { // 'X', 'O' or ' ' when it is free
+        for (bool player: {true, false}) {
+            if ((board(session, player)[cellID >> 6] >> (cellID & 63)) & 1) {
+                return player ? 'X' : 'O';
+            }
+        }
+        return ' ';
+    }
+
+    void setCell(size_t session, size_t cellID) {
+        boards[(2 * session + turn[session]) * words + (cellID >> 6)] |= uint64_t{1} << (cellID & 63);
+        history[session * rules.getFieldSize() + moveCount[session]] = static_cast<uint16_t>(cellID);
+        lastMove[session] = cellID;
+        ++moveCount[session];
+        turn[session] ^= 1;
+    }
+
+    [[nodiscard]] bool isWon(size_t session) const {
+        return moveCount[session] > 0 && rules.hasLineThrough(board(session, !turn[session]), lastMove[session]);
+    }
+
+    [[nodiscard]] bool isDraw(size_t session) const {
+        return moveCount[session] == rules.getFieldSize();
+    }
+
+    [[nodiscard]] std::span<const uint16_t> getMoves(size_t session) const { // for the archive
+        return {history.data() + session * rules.getFieldSize(), moveCount[session]};
+    }
+
+    [[nodiscard]] bool getTurn(size_t session) const {
+        return turn[session];
+    }
+
+    void setTurn(size_t session, bool value) { // a restored game starts with the side of the saved one
+        turn[session] = value;
+    }
+
+    [[nodiscard]] TicTacToe getBoard(size_t session) const { // a copy for the bot
+        TicTacToe copy = rules;
+        copy.load(board(session, false), moveCount[session], lastMove[session], turn[session]);
+        return copy;
+    }
+
+    [[nodiscard]] size_t size() const { // sessions in use
+        return inUse;
+    }
+
+    [[nodiscard]] size_t capacity() const {
+        return used.size();
+    }
+};
+
+#endif
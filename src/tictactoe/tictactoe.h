@@ -1,75 +1,125 @@
 #ifndef TICTACTOE_H
 #define TICTACTOE_H
 
-#include <set>
+#include <algorithm>
+#include <array>
+#include <vector>
 #include <cstddef>
+#include <cstdint>
+#include <stdexcept>
 
+// N x N board where K in a row wins.
+// Bitboard: one bitset per player, bit (row * cells + col) is set when the player owns the cell.
 class TicTacToe {
 private:
+    static const size_t MAXLINES = 2 * 8 + 2; // classic boards up to 8x8 have precomputed line masks
+    static constexpr int DIRECTIONS[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}}; // row, column, both diagonals
+
     size_t _cells;
+    size_t _winLength;
     size_t _moveCnt;
     size_t _fieldSize;
+    size_t _words; // 64-bit words in one player's bitset
+    size_t _lastMove;
     bool _turn;
-    char *field;
+    std::vector<uint64_t> _boards; // [0, _words) - 'O', [_words, 2 * _words) - 'X'
+    std::array<uint64_t, MAXLINES> _lines; // masks of every row, column and both diagonals
+    size_t _lineCnt;
 
-    bool isWonDiag() {
-        std::set<char> s;
-        for (size_t diag = 0; diag < _cells; ++diag) {
-            s.insert(field[diag * _cells + diag]);
-        }
-        if (!s.contains(0) && s.size() == 1) {
-            return true;
-        }
-        s.clear();
-        for (size_t diag = 0; diag < _cells; ++diag) {
-            s.insert(field[diag * _cells + (_cells - 1 - diag)]);
+    void generateLines() {
+        uint64_t mainDiag = 0, antiDiag = 0;
+        for (size_t i = 0; i < _cells; ++i) {
+            uint64_t row = 0, col = 0;
+            for (size_t j = 0; j < _cells; ++j) {
+                row |= uint64_t{1} << (i * _cells + j);
+                col |= uint64_t{1} << (j * _cells + i);
+            }
+            _lines[_lineCnt++] = row;
+            _lines[_lineCnt++] = col;
+            mainDiag |= uint64_t{1} << (i * _cells + i);
+            antiDiag |= uint64_t{1} << (i * _cells + (_cells - 1 - i));
         }
-        return (!s.contains(0) && s.size() == 1);
+        _lines[_lineCnt++] = mainDiag;
+        _lines[_lineCnt++] = antiDiag;
     }
 
-    bool isWonVert() {
-        for (size_t col = 0; col < _cells; ++col) {
-            std::set<char> s;
-            for (size_t row = 0; row < _cells; ++row) {
-                s.insert(field[_cells * row + col]);
-            }
-            if (!s.contains(0) && s.size() == 1) {
-                return true;
-            }
-        }
-        return false;
+    [[nodiscard]] bool isOwned(const uint64_t *board, size_t row, size_t col) const {
+        size_t cellID = row * _cells + col;
+        return (board[cellID >> 6] >> (cellID & 63)) & 1;
     }
 
-    bool isWonHor() {
-        for (size_t row = 0; row < _cells; ++row) {
-            std::set<char> s;
-            for (size_t col = 0; col < _cells; ++col) {
-                s.insert(field[_cells * row + col]);
-            }
-            if (!s.contains(0) && s.size() == 1) {
-                return true;
+    // counts the player's stones from the cell in one direction, stops after winLength - 1
+    [[nodiscard]] size_t countDirection(const uint64_t *board, size_t row, size_t col, int dRow, int dCol) const {
+        size_t count = 0;
+        for (size_t step = 1; step < _winLength; ++step) {
+            auto r = static_cast<ptrdiff_t>(row) + dRow * static_cast<ptrdiff_t>(step);
+            auto c = static_cast<ptrdiff_t>(col) + dCol * static_cast<ptrdiff_t>(step);
+            if (r < 0 || c < 0 || r >= static_cast<ptrdiff_t>(_cells) || c >= static_cast<ptrdiff_t>(_cells) ||
+                !isOwned(board, r, c)) {
+                break;
             }
+            ++count;
         }
-        return false;
+        return count;
     }
 
 public:
-    explicit TicTacToe(size_t cells = 3) : _cells(cells), _moveCnt(0), _fieldSize(_cells * _cells), _turn(false) {
-        field = new char[_fieldSize]{0};
-    }
-
-    ~TicTacToe() {
-        delete[] field;
+    explicit TicTacToe(size_t cells = 3, size_t winLength = 0) :
+            _cells(cells), _winLength(winLength == 0 ? cells : winLength), _moveCnt(0), _fieldSize(_cells * _cells),
+            _words((_fieldSize + 63) / 64), _lastMove(0), _turn(false), _boards(2 * _words), _lines{}, _lineCnt(0) {
+        if (_cells == 0 || _winLength > _cells) {
+            throw std::invalid_argument("Unsupported board size");
+        }
+        if (_winLength == _cells && _words == 1) {
+            generateLines();
+        }
     }
 
     void setCell(size_t cellID) {
-        field[cellID] = _turn ? 'X' : 'O';
+        _boards[_turn * _words + (cellID >> 6)] |= uint64_t{1} << (cellID & 63);
+        _lastMove = cellID;
         ++_moveCnt;
         _turn ^= 1;
     }
 
-    bool isWon() {
-        return isWonDiag() || isWonVert() || isWonHor();
+    void unsetCell(size_t cellID) { // takes back the last move, used by the search
+        _turn ^= 1;
+        --_moveCnt;
+        _boards[_turn * _words + (cellID >> 6)] &= ~(uint64_t{1} << (cellID & 63));
+    }
+
+    [[nodiscard]] bool isFree(size_t cellID) const {
+        return cellID < _fieldSize &&
+               !(((_boards[cellID >> 6] | _boards[_words + (cellID >> 6)]) >> (cellID & 63)) & 1);
+    }
+
+    [[nodiscard]] bool isOwnedBy(bool player, size_t cellID) const { // player is the value of getTurn()
+        return (_boards[player * _words + (cellID >> 6)] >> (cellID & 63)) & 1;
+    }
+
+    // only the player who made the last move can have a new line, and only through the last cell
+    [[nodiscard]] bool isWon() const {
+        return _moveCnt > 0 && hasLineThrough(_boards.data() + !_turn * _words, _lastMove);
+    }
+
+    // board is the bitset of one player, also used for boards kept outside, like in sessionPool
+    [[nodiscard]] bool hasLineThrough(const uint64_t *board, size_t cellID) const {
+        if (_lineCnt > 0) { // classic board, whole lines are compared at once
+            for (size_t i = 0; i < _lineCnt; ++i) {
+                if ((board[0] & _lines[i]) == _lines[i]) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        size_t row = cellID / _cells, col = cellID % _cells;
+        for (auto [dRow, dCol]: DIRECTIONS) {
+            if (1 + countDirection(board, row, col, dRow, dCol) + countDirection(board, row, col, -dRow, -dCol) >=
+                _winLength) {
+                return true;
+            }
+        }
+        return false;
     }
 
     [[nodiscard]] bool isDraw() const {
@@ -80,12 +130,39 @@ public:
         return _turn;
     }
 
+    [[nodiscard]] size_t getCells() const {
+        return _cells;
+    }
+
+    [[nodiscard]] size_t getWinLength() const {
+        return _winLength;
+    }
+
+    [[nodiscard]] size_t getFieldSize() const {
+        return _fieldSize;
+    }
+
+    [[nodiscard]] size_t getMoveCount() const {
+        return _moveCnt;
+    }
+
+    [[nodiscard]] size_t getWords() const {
+        return _words;
+    }
+
+    // the position from raw bitsets: _words of 'O', then _words of 'X'
+    void load(const uint64_t *boards, size_t moveCount, size_t lastMove, bool turn) {
+        std::copy(boards, boards + 2 * _words, _boards.begin());
+        _moveCnt = moveCount;
+        _lastMove = lastMove;
+        _turn = turn;
+    }
+
     void clear() {
-        delete[] field;
-        field = new char[_fieldSize]{0};
+        std::fill(_boards.begin(), _boards.end(), 0);
         _moveCnt = 0;
     }
 };
 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,179 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// One timer per id (a connection slot) in a hierarchical wheel: 4 levels of 64 slots with ticks of
+// 1 ms, 64 ms, 4 s and 4.4 min. schedule() and cancel() are O(1), a timer moves down a level at most 3 times
+// before it fires, and a bitmask of busy slots lets advance() skip empty time and nextDeadline() find the wakeup.
+class timerWheel {
+public:
+    using clock = std::chrono::steady_clock;
+
+private:
+    static constexpr size_t LEVELS = 4;
+    static constexpr size_t SLOTS = 64;
+    static constexpr size_t BITS = 6; // log2(SLOTS)
+    static constexpr uint32_t NONE = UINT32_MAX;
+    static constexpr size_t EXPIRED = LEVELS * SLOTS; // list of the timers being fired
+
+    struct timer {
+        uint64_t due = 0; // tick
+        uint32_t prev = NONE;
+        uint32_t next = NONE;
+        uint16_t slot = 0; // level * SLOTS + index
+        bool isScheduled = false;
+    };
+
+    clock::time_point origin; // tick 0
+    uint64_t now = 0; // the last processed tick
+    size_t count = 0;
+    std::vector<timer> timers; // by id
+    std::array<uint32_t, LEVELS * SLOTS + 1> heads;
+    std::array<uint64_t, LEVELS + 1> busy{}; // bit of every slot with timers, the last one is for EXPIRED
+
+    void link(uint32_t id, uint64_t from) { // from - the first tick that isn't processed yet
+        timer &t = timers[id];
+        const uint64_t tick = std::max(t.due, from); // late timers fire on the next tick
+        size_t level = 0; // the lowest one where the tick is less than a turn of blocks ahead
+        while (level + 1 < LEVELS && (tick >> (BITS * level)) - (from >> (BITS * level)) >= SLOTS) {
+            ++level;
+        }
+        // the top level keeps too far timers in its last slot, they are linked again when it is passed
+        const uint64_t ahead = std::min<uint64_t>((tick >> (BITS * level)) - (from >> (BITS * level)), SLOTS - 1);
+        const size_t index = ((from >> (BITS * level)) + ahead) & (SLOTS - 1);
+        t.slot = static_cast<uint16_t>(level * SLOTS + index);
+        t.prev = NONE;
+        t.next = heads[t.slot];
+        if (t.next != NONE) {
+            timers[t.next].prev = id;
+        }
+        heads[t.slot] = id;
+        busy[level] |= uint64_t{1} << index;
+    }
+
+    void unlink(uint32_t id) {
+        timer &t = timers[id];
+        (t.prev != NONE ? timers[t.prev].next : heads[t.slot]) = t.next;
+        if (t.next != NONE) {
+            timers[t.next].prev = t.prev;
+        }
+        if (heads[t.slot] == NONE) {
+            busy[t.slot / SLOTS] &= ~(uint64_t{1} << (t.slot % SLOTS));
+        }
+    }
+
+    void cascade(size_t level) { // timers of the slot that starts now go down to the levels below
+        const size_t slot = level * SLOTS + ((now >> (BITS * level)) & (SLOTS - 1));
+        while (heads[slot] != NONE) {
+            const uint32_t id = heads[slot];
+            unlink(id);
+            link(id, now); // the slot of now is processed right after
+        }
+    }
+
+    [[nodiscard]] uint64_t toTick(clock::time_point time) const { // rounded up, a timer never fires early
+        if (time <= origin) {
+            return 0;
+        }
+        const auto elapsed = time - origin;
+        const auto ticks = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+        return static_cast<uint64_t>(ticks) + (std::chrono::milliseconds(ticks) < elapsed);
+    }
+
+public:
+    explicit timerWheel(size_t capacity = 0, clock::time_point start = clock::now()) :
+            origin(start), timers(capacity) {
+        heads.fill(NONE);
+    }
+
+    void schedule(size_t id, clock::time_point when) { // moves the timer when it is already scheduled
+        cancel(id);
+        timers[id].due = toTick(when);
+        timers[id].isScheduled = true;
+        link(static_cast<uint32_t>(id), now + 1);
+        ++count;
+    }
+
+    void cancel(size_t id) {
+        if (!timers[id].isScheduled) {
+            return;
+        }
+        unlink(static_cast<uint32_t>(id));
+        timers[id].isScheduled = false;
+        --count;
+    }
+
+    [[nodiscard]] bool isScheduled(size_t id) const {
+        return timers[id].isScheduled;
+    }
+
+    [[nodiscard]] size_t size() const {
+        return count;
+    }
+
+    // calls expire(id) for every timer due by time, expire() may schedule and cancel any timer
+    template<typename F>
+    void advance(clock::time_point time, F &&expire) {
+        const auto ticks = std::chrono::duration_cast<std::chrono::milliseconds>(time - origin).count();
+        const uint64_t target = ticks > 0 ? static_cast<uint64_t>(ticks) : 0;
+        while (now < target) {
+            if (count == 0) { // nothing to fire or cascade
+                now = target;
+                return;
+            }
+            if (busy[0] == 0) { // no timer fires before the next cascade
+                now = std::min(target, now | (SLOTS - 1));
+                if (now == target) {
+                    return;
+                }
+            }
+            ++now;
+            for (size_t level = LEVELS - 1; level > 0; --level) { // higher first, they may fill a lower slot of now
+                if ((now & ((uint64_t{1} << (BITS * level)) - 1)) == 0) {
+                    cascade(level);
+                }
+            }
+            // moved away first, a timer scheduled by expire() for now + 64 goes to the same slot
+            const size_t slot = now & (SLOTS - 1);
+            heads[EXPIRED] = std::exchange(heads[slot], NONE);
+            busy[0] &= ~(uint64_t{1} << slot);
+            for (uint32_t id = heads[EXPIRED]; id != NONE; id = timers[id].next) {
+                timers[id].slot = EXPIRED;
+            }
+            while (heads[EXPIRED] != NONE) {
+                const uint32_t id = heads[EXPIRED];
+                unlink(id);
+                timers[id].isScheduled = false;
+                --count;
+                expire(static_cast<size_t>(id));
+            }
+        }
+    }
+
+    // the time to wake up: the first due timer or the first cascade that may bring one, max() when empty
+    [[nodiscard]] clock::time_point nextDeadline() const {
+        if (count == 0) {
+            return clock::time_point::max();
+        }
+        uint64_t next = UINT64_MAX;
+        for (size_t level = 0; level < LEVELS; ++level) {
+            if (busy[level] == 0) {
+                continue;
+            }
+            const uint64_t block = now >> (BITS * level);
+            const uint64_t ahead = std::countr_zero(std::rotr(busy[level], static_cast<int>((block + 1) & (SLOTS - 1))));
+            next = std::min(next, (block + 1 + ahead) << (BITS * level));
+        }
+        return origin + std::chrono::milliseconds(next);
+    }
+};
+
+#endif
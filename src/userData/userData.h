@@ -1,13 +1,14 @@
 #ifndef USERDATA_H
 #define USERDATA_H
 
-#include <string>
+#include <cstdint>
 
-struct userData {
-    std::string password;
-    bool isLogged;
-    bool isPlaying;
-    size_t activeSession;
+struct userData { // runtime state of a user, the login and the password are in userStore
+    uint32_t id = 0; // registration number, the index in the states
+    uint32_t shared = UINT32_MAX; // slot in the shared table of a cluster
+    bool isLogged = false;
+    bool isPlaying = false;
+    int rating = 1200; // Elo
 };
 
 #endif
@@ -0,0 +1,170 @@
+#ifndef USERJOURNAL_H
+#define USERJOURNAL_H
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// Append-only write-ahead log of registrations, one "login:password" line per user like in the old .db file.
+// append() only buffers a record, flush() writes every buffered record with one fdatasync (group commit).
+class userJournal {
+private:
+    std::string path;
+    int fd = -1;
+
+    std::mutex mutex; // guards pending and lastSeq
+    std::string pending;
+    uint64_t lastSeq = 0;
+
+    std::mutex syncMutex; // one writer of the file at a time
+    std::atomic<uint64_t> durableSeq{0};
+    std::atomic<size_t> records{0}; // records in the current file
+
+    void open() {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            throw std::invalid_argument("Can't open journal: " + path);
+        }
+    }
+
+    void trimTornTail() { // a crash in the middle of a write leaves a line without '\n', new records must not join it
+        off_t end = lseek(fd, 0, SEEK_END);
+        char last = '\n';
+        while (end > 0 && pread(fd, &last, 1, end - 1) == 1 && last != '\n') {
+            --end;
+        }
+        if (end != lseek(fd, 0, SEEK_END) && ftruncate(fd, end) < 0) {
+            throw std::invalid_argument("Can't repair journal: " + path);
+        }
+    }
+
+public:
+    static void syncDirectory(const std::string &file) { // makes renames durable
+        const size_t slash = file.rfind('/');
+        const std::string directory = slash == std::string::npos ? "." : file.substr(0, slash);
+        int dir = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+        if (dir >= 0) {
+            fsync(dir);
+            close(dir);
+        }
+    }
+
+    explicit userJournal(std::string path) : path(std::move(path)) {
+        open();
+        trimTornTail();
+    }
+
+    userJournal(const userJournal &) = delete;
+
+    userJournal &operator=(const userJournal &) = delete;
+
+    ~userJournal() {
+        flush(UINT64_MAX);
+        close(fd);
+    }
+
+    // returns the sequence number to wait for with flush()
+    uint64_t append(std::string_view login, std::string_view password) {
+        std::lock_guard lock(mutex);
+        pending.append(login).append(1, ':').append(password).append(1, '\n');
+        return ++lastSeq;
+    }
+
+    // makes every record up to seq durable, records of other threads are written in the same batch
+    void flush(uint64_t seq) {
+        if (durableSeq.load(std::memory_order_acquire) >= seq) {
+            return;
+        }
+        std::lock_guard syncLock(syncMutex);
+        std::string batch;
+        uint64_t batchSeq;
+        {
+            std::lock_guard lock(mutex);
+            batch.swap(pending);
+            batchSeq = lastSeq;
+        }
+        if (batch.empty()) {
+            return;
+        }
+        for (size_t written = 0; written < batch.size();) {
+            ssize_t result = write(fd, batch.data() + written, batch.size() - written);
+            if (result < 0 && errno != EINTR) {
+                throw std::invalid_argument("Can't write journal: " + path);
+            }
+            written += result > 0 ? result : 0;
+        }
+        if (fdatasync(fd) < 0) {
+            throw std::invalid_argument("Can't sync journal: " + path);
+        }
+        records.fetch_add(std::count(batch.begin(), batch.end(), '\n'), std::memory_order_relaxed);
+        durableSeq.store(batchSeq, std::memory_order_release);
+    }
+
+    [[nodiscard]] size_t size() const { // durable records since the last rotation
+        return records.load(std::memory_order_relaxed);
+    }
+
+    // moves the current file to oldPath and starts an empty one, buffered records go to the new file;
+    // the caller must keep new records out until it has the whole table to snapshot
+    void rotate(const std::string &oldPath) {
+        std::lock_guard syncLock(syncMutex);
+        if (rename(path.c_str(), oldPath.c_str()) < 0) {
+            throw std::invalid_argument("Can't rotate journal: " + path);
+        }
+        close(fd);
+        open();
+        syncDirectory(path);
+        records = 0;
+    }
+
+    // calls add(login, password) for every whole line, a torn last line of a crash is skipped
+    static bool replay(const std::string &file, const std::function<void(std::string_view, std::string_view)> &add) {
+        std::ifstream in(file, std::ios::binary);
+        if (!in.is_open()) {
+            return false;
+        }
+        const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        for (size_t begin = 0, end; (end = data.find('\n', begin)) != std::string::npos; begin = end + 1) {
+            std::string_view line(data.data() + begin, end - begin);
+            if (size_t colon = line.find(':'); colon != std::string_view::npos) {
+                add(line.substr(0, colon), line.substr(colon + 1));
+            }
+        }
+        return true;
+    }
+
+    // writes next to the file and renames it over, so a crash leaves the old or the new one
+    static void writeFile(const std::string &file, std::string_view data) {
+        const std::string temporary = file + ".tmp";
+        int out = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (out < 0) {
+            throw std::invalid_argument("Can't write snapshot: " + temporary);
+        }
+        for (size_t written = 0; written < data.size();) {
+            ssize_t result = write(out, data.data() + written, data.size() - written);
+            if (result < 0 && errno != EINTR) {
+                close(out);
+                throw std::invalid_argument("Can't write snapshot: " + temporary);
+            }
+            written += result > 0 ? result : 0;
+        }
+        fsync(out);
+        close(out);
+        if (rename(temporary.c_str(), file.c_str()) < 0) {
+            throw std::invalid_argument("Can't replace snapshot: " + file);
+        }
+        syncDirectory(file);
+    }
+};
+
+#endif
@@ -0,0 +1,283 @@
+#ifndef USERSTORE_H
+#define USERSTORE_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "userJournal.h"
+
+// Logins and passwords in a fixed-width open-addressing hash table, saved as one file:
+// a header and the slots exactly as they are in memory. The file is mapped copy-on-write on startup,
+// so nothing is parsed, and new users change only the private pages until the next save().
+// save() writes only the slots changed since the last one in place, the whole file only after the table grew.
+class userStore {
+public:
+    static const size_t LOGINSIZE = 32;
+    static const size_t PASSWORDSIZE = 32;
+
+    struct record {
+        uint64_t hash; // 0 - free slot
+        uint32_t id; // registration number, index of the runtime state
+        uint8_t loginSize;
+        uint8_t passwordSize;
+        uint16_t rating; // Elo rating of the last snapshot, 0 - not saved yet
+        char login[LOGINSIZE];
+        char password[PASSWORDSIZE];
+
+        [[nodiscard]] std::string_view getLogin() const {
+            return {login, loginSize};
+        }
+
+        [[nodiscard]] std::string_view getPassword() const {
+            return {password, passwordSize};
+        }
+    };
+
+    static_assert(sizeof(record) == 80);
+
+private:
+    struct header {
+        char magic[8];
+        uint64_t capacity; // slots, power of two
+        uint64_t count;
+        uint64_t recordSize;
+    };
+
+public:
+    struct changes { // taken under the lock by takeChanges(), written by save() without it
+        header head{};
+        std::string image; // the whole file when the table has no file of its size yet, empty otherwise
+        std::vector<std::pair<size_t, record>> records; // changed slots
+    };
+
+private:
+
+    static constexpr char MAGIC[8] = "TTTUSR1";
+    static const size_t MINCAPACITY = 1024;
+
+    void *mapping = MAP_FAILED;
+    size_t mappingSize = 0;
+    record *slots = nullptr;
+    size_t capacity = 0;
+    size_t count = 0;
+    size_t savedCapacity = 0; // of the file, 0 - there is no file of this table
+    std::vector<size_t> dirty; // slots changed since the last takeChanges(), may repeat
+
+    static uint64_t hash(std::string_view login) { // FNV-1a, never 0
+        uint64_t value = 14695981039346656037ull;
+        for (char c: login) {
+            value = (value ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+        }
+        return value ? value : 1;
+    }
+
+    void unmap() {
+        if (mapping != MAP_FAILED) {
+            munmap(mapping, mappingSize);
+            mapping = MAP_FAILED;
+        }
+    }
+
+    void allocate(size_t newCapacity) { // empty anonymous table
+        mappingSize = newCapacity * sizeof(record);
+        mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping == MAP_FAILED) {
+            throw std::invalid_argument("Can't allocate user table");
+        }
+        slots = static_cast<record *>(mapping);
+        capacity = newCapacity;
+    }
+
+    [[nodiscard]] header makeHeader() const {
+        header head{{}, capacity, count, sizeof(record)};
+        memcpy(head.magic, MAGIC, sizeof(MAGIC));
+        return head;
+    }
+
+    record &probe(uint64_t value, std::string_view login) const { // the slot of the login or the free one
+        for (size_t i = value & (capacity - 1);; i = (i + 1) & (capacity - 1)) {
+            record &current = slots[i];
+            if (current.hash == 0 || (current.hash == value && current.getLogin() == login)) {
+                return current;
+            }
+        }
+    }
+
+    void grow() {
+        void *oldMapping = mapping;
+        const size_t oldSize = mappingSize;
+        const record *oldSlots = slots;
+        const size_t oldCapacity = capacity;
+        mapping = MAP_FAILED;
+        allocate(2 * oldCapacity);
+        for (size_t i = 0; i < oldCapacity; ++i) {
+            if (oldSlots[i].hash != 0) {
+                probe(oldSlots[i].hash, oldSlots[i].getLogin()) = oldSlots[i];
+            }
+        }
+        munmap(oldMapping, oldSize);
+        dirty.clear(); // the slots moved, the next save() writes the whole file
+    }
+
+public:
+    explicit userStore(const std::string &path = "") {
+        int fd = path.empty() ? -1 : open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            allocate(MINCAPACITY);
+            return;
+        }
+        struct stat info{};
+        header head{};
+        if (fstat(fd, &info) < 0 || pread(fd, &head, sizeof(head), 0) != sizeof(head) ||
+            memcmp(head.magic, MAGIC, sizeof(MAGIC)) != 0 || head.recordSize != sizeof(record) ||
+            !std::has_single_bit(head.capacity) || head.count * 2 > head.capacity ||
+            static_cast<uint64_t>(info.st_size) != sizeof(header) + head.capacity * sizeof(record)) {
+            close(fd);
+            throw std::invalid_argument("Broken user store: " + path);
+        }
+        mappingSize = info.st_size;
+        mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            throw std::invalid_argument("Can't map user store: " + path);
+        }
+        slots = reinterpret_cast<record *>(static_cast<char *>(mapping) + sizeof(header));
+        capacity = head.capacity;
+        count = head.count;
+        savedCapacity = capacity;
+    }
+
+    userStore(const userStore &) = delete;
+
+    userStore &operator=(const userStore &) = delete;
+
+    ~userStore() {
+        unmap();
+    }
+
+    // a login goes into the journal text, so it can't have ':' or a line break
+    static bool fits(std::string_view login, std::string_view password) {
+        return !login.empty() && login.size() <= LOGINSIZE && login.find_first_of(":\n") == std::string_view::npos &&
+               !password.empty() && password.size() <= PASSWORDSIZE && password.find('\n') == std::string_view::npos;
+    }
+
+    // one probe sequence, the pointer is valid until the next insert()
+    [[nodiscard]] const record *find(std::string_view login) const {
+        const record &found = probe(hash(login), login);
+        return found.hash ? &found : nullptr;
+    }
+
+    // nullptr when the login is taken or doesn't fit
+    const record *insert(std::string_view login, std::string_view password) {
+        if (!fits(login, password) || find(login)) {
+            return nullptr;
+        }
+        if ((count + 1) * 2 > capacity) {
+            grow();
+        }
+        const uint64_t value = hash(login);
+        record &slot = probe(value, login);
+        slot = {value, static_cast<uint32_t>(count), static_cast<uint8_t>(login.size()),
+                static_cast<uint8_t>(password.size()), 0, {}, {}};
+        memcpy(slot.login, login.data(), login.size());
+        memcpy(slot.password, password.data(), password.size());
+        ++count;
+        dirty.push_back(static_cast<size_t>(&slot - slots));
+        return &slot;
+    }
+
+    // false when the user is unknown or has this rating saved already
+    bool setRating(std::string_view login, int rating) {
+        record &found = probe(hash(login), login);
+        const auto value = static_cast<uint16_t>(std::clamp(rating, 1, UINT16_MAX));
+        if (!found.hash || found.rating == value) {
+            return false;
+        }
+        found.rating = value;
+        dirty.push_back(static_cast<size_t>(&found - slots));
+        return true;
+    }
+
+    [[nodiscard]] size_t size() const {
+        return count;
+    }
+
+    [[nodiscard]] size_t getCapacity() const { // slots, they move when the table grows
+        return capacity;
+    }
+
+    template<typename F>
+    void forEach(F &&function) const { // in the order of slots
+        forEach(0, capacity, function);
+    }
+
+    template<typename F>
+    void forEach(size_t begin, size_t end, F &&function) const { // slots [begin, end)
+        for (size_t i = begin; i < end; ++i) {
+            if (slots[i].hash != 0) {
+                function(slots[i]);
+            }
+        }
+    }
+
+    // copies of the slots changed since the last call, the whole table only when it has no file of its size,
+    // that is after it doubled
+    [[nodiscard]] changes takeChanges() {
+        changes taken;
+        taken.head = makeHeader();
+        if (savedCapacity != capacity) {
+            taken.image.resize(sizeof(header) + capacity * sizeof(record));
+            memcpy(taken.image.data(), &taken.head, sizeof(header));
+            memcpy(taken.image.data() + sizeof(header), slots, capacity * sizeof(record));
+            savedCapacity = capacity;
+        } else {
+            std::sort(dirty.begin(), dirty.end());
+            dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+            taken.records.reserve(dirty.size());
+            for (size_t slot: dirty) {
+                taken.records.emplace_back(slot, slots[slot]);
+            }
+        }
+        dirty.clear();
+        return taken;
+    }
+
+    void forgetSaved() { // save() failed, the next one writes the whole file
+        savedCapacity = 0;
+    }
+
+    // the header goes first, so the users of a save cut by a crash get new ids when the journal is replayed
+    static void save(const std::string &path, const changes &taken) {
+        if (!taken.image.empty()) {
+            userJournal::writeFile(path, taken.image);
+            return;
+        }
+        int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+        bool isWritten = fd >= 0 && pwrite(fd, &taken.head, sizeof(header), 0) == sizeof(header);
+        for (size_t i = 0; isWritten && i < taken.records.size(); ++i) {
+            const auto &[slot, user] = taken.records[i];
+            isWritten = pwrite(fd, &user, sizeof(record), static_cast<off_t>(sizeof(header) + slot * sizeof(record))) ==
+                        sizeof(record);
+        }
+        isWritten = isWritten && fdatasync(fd) == 0;
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (!isWritten) {
+            throw std::invalid_argument("Can't write snapshot: " + path);
+        }
+    }
+};
+
+#endif